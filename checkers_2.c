@@ -1,36 +1,559 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
 #include <omp.h>
 #include <mpi.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// hardware performance counters around the search, read through perf_event_open on Linux
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define PERF_COUNTERS 1
+#endif
+
+// search counters printed after each move, left out of release builds (compiled with -DNDEBUG)
+#ifndef NDEBUG
+#define SEARCH_STATS 1
+#endif
 
 #define BOARD_SIZE 8
+#define NUM_SQUARES 32
 #define EMPTY_CELL 0
 #define PLAYER1 1
 #define PLAYER2 2
-
-void initializeBoard(int board[BOARD_SIZE][BOARD_SIZE]);
-void printBoard(int board[BOARD_SIZE][BOARD_SIZE]);
-void copyBoard(int src[BOARD_SIZE][BOARD_SIZE], int dest[BOARD_SIZE][BOARD_SIZE]);
+#define MAX_THREADS 256
+#define DEFAULT_HASH_MB 64
+#define MAX_SEARCH_DEPTH 64
+#define MIN_SPAWN_DEPTH 3 // nodes closer to the leaves are searched by a single thread, without spawning tasks
+#define TAG_JOB 1 // rank 0 sends a root move to search and the bound to search it with
+#define TAG_RESULT 2 // a worker sends back the score of the move and whether it finished
+#define TAG_STOP 3 // no more moves at this depth
+#define NO_SCORE -10000 // lower than any score, for ranks without a move to propose
+#define DEFAULT_DISTRIBUTED_HASH_MB 64 // part of the distributed transposition table held by each rank
+#define DISTRIBUTED_MIN_DEPTH 4 // shallower results are not worth a message to another rank
+#define MAX_QUIESCENCE_DEPTH 16 // plies of captures and promotions searched past the horizon
+#define MAX_BENCHMARK_RUNS 32 // thread or rank counts of a benchmark sweep
+#define STATS_SAMPLE_RATE 64 // one call in this many is timed by the search counters
+#define CUTOFF_INDEX_BUCKETS 8 // cutoffs counted by the index of the move that cut, the last one for the later moves
+#define TRACE_EVENTS_PER_THREAD 262144 // spans each thread can record, the later ones are dropped
+#define TRACE_TASK_DEPTH 2 // tasks deeper in the tree are not traced, there are too many of them
+#define BATCH_LINE_LENGTH 64 // longest line of a batch of positions, longer ones are not positions
+#define BATCH_POSITIONS_PER_THREAD 16 // positions of a batch read at a time for each thread
+
+// center of the board (rows 3-4 and columns 2-5)
+#define CENTER_MASK 0x00066000u
+
+// squares of the evaluation terms, rows 0-3 have the bits 0-15
+#define EVEN_ROWS_MASK 0x0F0F0F0Fu
+#define LEFT_EDGE_MASK 0x10101010u // column 0, only on odd rows
+#define RIGHT_EDGE_MASK 0x08080808u // column 7, only on even rows
+#define PLAYER1_BACK_RANK_MASK 0xF0000000u
+#define PLAYER2_BACK_RANK_MASK 0x0000000Fu
+#define PLAYER1_RUNAWAY_MASK 0x00000FFFu // the last three rows before being crowned
+#define PLAYER2_RUNAWAY_MASK 0xFFF00000u
+
+// evaluation terms, each one counts the pieces of PLAYER2 minus those of PLAYER1 on some squares
+// (or their moves for the mobility) and the evaluation is the sum of the counts times the weights
+#define TERM_MAN 0
+#define TERM_KING 1
+#define TERM_MAN_CENTER 2
+#define TERM_KING_CENTER 3
+#define TERM_PIECE 4 // men and kings
+#define TERM_BACK_RANK 5 // men guarding their own back rank
+#define TERM_RUNAWAY 6 // men close to being crowned
+#define TERM_MOBILITY 7 // moves without captures
+#define NUM_TERMS 8
+
+// endgame tablebase values, one byte for each position and player to move
+// 0 is a draw, TB_LOSS + plies a loss and TB_WIN + plies a win of the player to move
+// (a player without moves has lost in 0 plies)
+#define TB_LOSS 1
+#define TB_WIN 128
+#define TB_MAX_DISTANCE 126
+#define TB_MAX_PIECES 5
+#define TB_SCORE 9000 // score of a win in the tablebase, minus the plies to win
+
+// default weights, can be set at compile time (-DKING_WEIGHT=250) or loaded from a file with -weights
+#ifndef MAN_WEIGHT
+#define MAN_WEIGHT 100
+#endif
+#ifndef KING_WEIGHT
+#define KING_WEIGHT 300
+#endif
+#ifndef MAN_CENTER_WEIGHT
+#define MAN_CENTER_WEIGHT 50
+#endif
+#ifndef KING_CENTER_WEIGHT
+#define KING_CENTER_WEIGHT 100
+#endif
+#ifndef PIECE_WEIGHT
+#define PIECE_WEIGHT 10
+#endif
+#ifndef BACK_RANK_WEIGHT
+#define BACK_RANK_WEIGHT 0
+#endif
+#ifndef RUNAWAY_WEIGHT
+#define RUNAWAY_WEIGHT 0
+#endif
+#ifndef MOBILITY_WEIGHT
+#define MOBILITY_WEIGHT 0
+#endif
+
+// packed board, one bit for each of the 32 dark squares
+// square = row * 4 + col / 2
+typedef struct {
+	uint32_t pieces[2]; // pieces of PLAYER1 and PLAYER2
+	uint32_t kings; // which of those pieces are kings
+	int score; // evaluatePosition of the pieces, kept up to date like the hash
+	uint64_t hash; // zobrist key of the pieces and the player to move
+} Board;
+
+// what makeMove changed, enough for unmakeMove to restore the board
+typedef struct {
+	int8_t from, to; // squares of the move
+	int8_t movedPiece; // piece that moved, before any promotion
+	int8_t capturedSquare; // -1 if nothing was captured
+	int8_t capturedPiece;
+	int8_t promoted;
+} MoveUndo;
+
+// a move packed in 32 bits, (from square << 5) | to square as moveToKey,
+// then whether it captures or promotes and the square of the captured piece
+typedef uint32_t Move;
+
+#define MOVE_KEY_MASK 0x3FFu
+#define MOVE_CAPTURE 0x400u // for kings possibly one of their own pieces
+#define MOVE_PROMOTION 0x800u
+#define MOVE_CAPTURED_SHIFT 12
+
+// the move lists of the plies a thread is searching, each list is taken from the top of the stack
+// and given back before the search of its position returns
+// a task that waits for its children may run other tasks on its thread, but those give their lists
+// back before it resumes, so the lists of a thread are always released in the reverse order
+#define MOVE_STACK_SIZE 16384
+typedef struct {
+	Move moves[MOVE_STACK_SIZE];
+	int top;
+} __attribute__((aligned(64))) MoveStack;
+
+// diagonal directions, indexes of the move tables
+#define UP_LEFT 0
+#define UP_RIGHT 1
+#define DOWN_LEFT 2
+#define DOWN_RIGHT 3
+
+// evaluation weights, with the names used in the weights file
+int evaluationWeights[NUM_TERMS] = {
+	MAN_WEIGHT, KING_WEIGHT, MAN_CENTER_WEIGHT, KING_CENTER_WEIGHT,
+	PIECE_WEIGHT, BACK_RANK_WEIGHT, RUNAWAY_WEIGHT, MOBILITY_WEIGHT
+};
+const char* evaluationTermNames[NUM_TERMS] = {
+	"man", "king", "manCenter", "kingCenter", "piece", "backRank", "runaway", "mobility"
+};
+
+// what each piece on each square adds to the evaluation, every term but the mobility
+int pieceSquareTable[5][NUM_SQUARES];
+
+// endgame tablebase file, a header and then the values of the positions with 1, 2, ... pieces
+typedef struct {
+	char magic[8];
+	uint32_t pieces; // largest number of pieces on the board
+	uint32_t reserved;
+} TablebaseHeader;
+
+// mapped tablebase values, NULL when there is no tablebase
+uint8_t* tablebase = NULL;
+int tablebasePieces = 0;
+size_t tablebaseFileSize = 0;
+
+// binomial coefficients for the index of the occupied squares
+// and the start of the values of each number of pieces
+uint64_t binomial[NUM_SQUARES + 1][TB_MAX_PIECES + 1];
+uint64_t tablebaseOffsets[TB_MAX_PIECES + 2];
+
+// opening book file, a header and then the entries sorted by hash
+typedef struct {
+	char magic[8];
+	uint64_t entries;
+} BookHeader;
+
+typedef struct {
+	uint64_t hash; // of the position, player 2 to move
+	int32_t move; // as moveToKey
+	int32_t score;
+} BookEntry;
+
+// mapped book entries, NULL when there is no book
+BookEntry* openingBook = NULL;
+uint64_t openingBookEntries = 0;
+
+// neighbor and jump landing square in each direction, -1 when off the board
+int neighborSquare[NUM_SQUARES][4];
+int jumpSquare[NUM_SQUARES][4];
+
+// zobrist keys for each piece (indexed by the cell encoding) on each square
+// and for player 2 being the one to move
+uint64_t zobristPieces[5][NUM_SQUARES];
+uint64_t zobristTurn;
+
+// transposition table bound types
+#define TT_EXACT 0
+#define TT_LOWER 1 // the score is a lower bound (the search failed high)
+#define TT_UPPER 2 // the score is an upper bound (the search failed low)
+
+// transposition table entry, the key is stored xored with the data so an entry
+// torn by two threads writing at the same time does not validate on probe
+typedef struct {
+	uint64_t key;
+	uint64_t data; // score, depth, bound, best move and age
+} TTEntry;
+
+// transposition table counters, one cache line per thread
+typedef struct {
+	uint64_t probes;
+	uint64_t hits;
+	uint64_t cutoffs;
+	uint64_t stores;
+} __attribute__((aligned(64))) TTStats;
+
+TTEntry* transpositionTable = NULL;
+uint64_t transpositionMask = 0;
+uint64_t transpositionAge = 0;
+TTStats transpositionStats[MAX_THREADS];
+
+// distributed transposition table, each rank holds a part of it in an MPI window and a position
+// belongs to rank hash % size, the transposition table of the rank works as a cache in front of it
+MPI_Win distributedWindow;
+TTEntry* distributedTable = NULL;
+uint64_t distributedMask = 0;
+int distributedRanks = 1; // 1 when there is no distributed table
+
+// the ranks taking part in the search, MPI_COMM_WORLD except in the benchmark runs with fewer ranks
+MPI_Comm searchCommunicator;
+
+// root moves of a depth handed out by rank 0 to the MPI workers, rank 0 takes some of them too
+// and answers the workers between the nodes of its own searches
+typedef struct {
+	Move* moves;
+	int numMoves;
+	int nextMove;
+	int* assigned; // the move each worker is searching
+	int busyWorkers;
+	int bestScore;
+	int bestMoveIndex;
+} RootQueue;
+RootQueue rootQueue;
+
+// move ordering tables, each thread keeps its own
+// killers are indexed by ply, history by player and the from and to squares
+typedef struct {
+	int killers[MAX_SEARCH_DEPTH][2];
+	int history[2][NUM_SQUARES][NUM_SQUARES];
+	uint64_t cutoffs; // nodes where a move caused a cutoff
+	uint64_t firstMoveCutoffs; // of those, nodes where it was the first move searched
+} __attribute__((aligned(64))) OrderingTables;
+
+OrderingTables orderingTables[MAX_THREADS];
+
+MoveStack moveStacks[MAX_THREADS];
+
+// a timed search gives up once the clock passes the deadline (0 for no deadline)
+// and a benchmark search once its threads searched the node limit (0 for no limit)
+double searchDeadline = 0;
+uint64_t searchNodeLimit = 0;
+uint64_t searchNodes = 0; // nodes of all the threads, added 1024 at a time
+int searchAborted = 0;
+
+// nodes searched by each thread, one cache line per thread, the clock is only read every so often
+typedef struct {
+	uint64_t nodes;
+} __attribute__((aligned(64))) NodeCount;
+
+NodeCount nodeCounts[MAX_THREADS];
+
+#ifdef SEARCH_STATS
+// search counters, padded to whole cache lines per thread
+// the times are in nanoseconds, measured on one call in STATS_SAMPLE_RATE and scaled up
+typedef struct {
+	uint64_t nodes[MAX_SEARCH_DEPTH]; // nodes before the horizon, by depth
+	uint64_t quiescenceNodes; // only in the sum, the nodes counted past the horizon
+	uint64_t evaluations;
+	uint64_t cutoffs[CUTOFF_INDEX_BUCKETS];
+	uint64_t generations; // calls of getPossibleMoves
+	uint64_t movesGenerated;
+	uint64_t captureGenerations; // calls of getCaptureMoves
+	uint64_t generationTime;
+	uint64_t evaluationTime;
+} __attribute__((aligned(64))) SearchStats;
+
+SearchStats searchStats[MAX_THREADS];
+
+// seconds it takes to read the clock, taken out of each timed call
+double clockOverhead = 0;
+#endif
+
+#ifdef PERF_COUNTERS
+// hardware events counted during each search, a counter only counts the thread that opened it
+#define NUM_PERF_EVENTS 5
+const char* perfEventNames[NUM_PERF_EVENTS] = { "cycles", "instructions", "L1 data misses", "LLC misses", "branch misses" };
+int perfEventFiles[MAX_THREADS][NUM_PERF_EVENTS]; // -1 for the events that could not be opened
+int perfThreads = 0; // threads with counters, 0 when they are not used
+#endif
+
+// kinds of spans of the trace, the waits between ranks are only in the MPI program
+#define TRACE_DEPTH 0 // one iteration of the iterative deepening
+#define TRACE_ROOT_MOVE 1
+#define TRACE_TASK 2 // a subtree searched as a task, near the root only
+#define TRACE_LOCK 3 // waiting for and holding the lock of the root
+#define TRACE_WAIT_JOB 4 // a worker waiting for a root move
+#define TRACE_WAIT_RESULT 5 // rank 0 waiting for a worker to finish a root move
+#define TRACE_BROADCAST 6
+#define TRACE_REDUCE 7
+#define NUM_TRACE_KINDS 8
+const char* traceNames[NUM_TRACE_KINDS] = {
+	"depth", "root move", "task", "lock", "wait for job", "wait for result", "broadcast", "allreduce"
+};
+// name of the value recorded with each kind of span, NULL for none
+const char* traceArgNames[NUM_TRACE_KINDS] = { "plies", "move", "depth", "move", NULL, NULL, NULL, "plies" };
+
+// a span of the trace, the times are seconds since the trace started
+typedef struct {
+	int kind;
+	int thread;
+	int arg;
+	double start;
+	double end;
+} TraceEvent;
+
+// spans recorded by each thread, allocated up front so recording only writes to memory already there
+typedef struct {
+	TraceEvent* events;
+	int count;
+	int capacity;
+	uint64_t dropped;
+} __attribute__((aligned(64))) TraceBuffer;
+
+TraceBuffer traceBuffers[MAX_THREADS];
+int tracing = 0;
+double traceStart = 0;
+
+// positions searched by the benchmark, with the AI (player 2) to move
+const char* benchmarkPositions[][2] = {
+	{ "opening", "oooooooooooo....x....xxxxxxxxxxx" },
+	{ "middlegame", "o.oo.oo.o..o.o....x.x.x..xx.xx.x" },
+	{ "king endgame", ".....O........o..X........x.O..X" },
+};
+
+#define NUM_BENCHMARK_POSITIONS (int)(sizeof(benchmarkPositions) / sizeof(benchmarkPositions[0]))
+
+// result of searching a benchmark position
+typedef struct {
+	int depth; // plies of the deepest completed search
+	int move[4];
+	int score;
+	uint64_t nodes;
+	double seconds;
+	double depthSeconds[MAX_SEARCH_DEPTH]; // time from the start until each depth was completed
+} BenchmarkResult;
+
+// result of analyzing a position of a batch, all 64 bit so the ranks can add them up
+typedef struct {
+	int64_t move; // 0 when there are no moves, -1 for a line that is not a position
+	int64_t score;
+	int64_t depth;
+	int64_t nodes;
+} AnalysisResult;
+
+int squareIndex(int row, int col);
+int squareRow(int square);
+int squareCol(int square);
+int getSquare(Board* board, int square);
+void setSquare(Board* board, int square, int piece);
+int getCell(Board* board, int row, int col);
+void setCell(Board* board, int row, int col, int piece);
+int countPieces(Board* board, int turn);
+void initializeZobrist();
+uint64_t computeHash(Board* board, int turn);
+void initializeTranspositionTable(size_t megabytes);
+TTEntry loadTransposition(TTEntry* slot);
+int checkTransposition(TTEntry entry, uint64_t hash, int depth, int alpha, int beta, int* score, int* bestMove);
+int probeTransposition(uint64_t hash, int depth, int alpha, int beta, int* score, int* bestMove);
+uint64_t packTransposition(int depth, int score, int bound, int bestMove);
+int writeTransposition(TTEntry* slot, uint64_t hash, uint64_t data);
+void storeTransposition(uint64_t hash, int depth, int score, int bound, int bestMove);
+void initializeDistributedTable(size_t megabytes, int numProcesses);
+void freeDistributedTable();
+int isDistributed(int depth);
+TTEntry getDistributedEntry(uint64_t hash);
+void putDistributedEntry(uint64_t hash, uint64_t data);
+void resetTranspositionStats();
+TTStats sumTranspositionStats();
+void printTranspositionStats(TTStats* total);
+void initializeBoard(Board* board);
+void printBoard(Board* board);
+int parsePosition(const char* squares, const char* player, Board* board, int* turn);
 int isNotWithinBounds(int toRow, int toCol);
-int isValidMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int fromRow, int fromCol, int toRow, int toCol);
-void makeMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int fromRow, int fromCol, int toRow, int toCol);
-int isGameOver(int board[BOARD_SIZE][BOARD_SIZE]);
-int getPlayerMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int* fromRow, int* fromCol, int* toRow, int* toCol);
-void getPossibleMoves(int board[BOARD_SIZE][BOARD_SIZE], int turn, int possibleMoves[100][4], int* numMoves);
-int hasValidMoves(int board[BOARD_SIZE][BOARD_SIZE], int turn);
-int evaluatePosition(int board[BOARD_SIZE][BOARD_SIZE]);
-int minimax(int board[BOARD_SIZE][BOARD_SIZE], int maxDepth, int depth, int turn, int alpha, int beta);
-int getBestMoveForOpponent(int board[BOARD_SIZE][BOARD_SIZE], int turn, int maxDepth, int* fromRow, int* fromCol, int* toRow, int* toCol, int* score, int rank, int numProcesses);
+int isValidMove(Board* board, int turn, int fromRow, int fromCol, int toRow, int toCol);
+Move createMove(Board* board, int turn, int fromRow, int fromCol, int toRow, int toCol);
+MoveUndo makeMove(Board* board, int turn, Move move);
+void unmakeMove(Board* board, MoveUndo undo);
+int isGameOver(Board* board);
+int getPlayerMove(Board* board, int turn, int* fromRow, int* fromCol, int* toRow, int* toCol);
+Move* getPossibleMoves(Board* board, int turn, int* numMoves);
+Move* getCaptureMoves(Board* board, int turn, int* numMoves);
+void releaseMoves(int numMoves);
+int hasValidMoves(Board* board, int turn);
+void initializeMoveTables();
+void addMove(MoveStack* stack, int from, Move target);
+void loadEvaluationWeights(const char* path);
+void initializeEvaluation();
+int countMobility(Board* board, int turn);
+void countFeatures(Board* board, int features[NUM_TERMS]);
+int computeEvaluation(Board* board);
+int evaluatePosition(Board* board);
+int parseCounts(const char* list, int* counts, int maxCount);
+int sweepCounts(int maxCount, int* counts);
+BenchmarkResult benchmarkPosition(Board* board, int turn, int maxDepth, uint64_t maxNodes, int rank, int numProcesses);
+void printBenchmarkRunStart(int ranks, int threads, int json, int first);
+void printBenchmarkPosition(const char* name, BenchmarkResult* result, int json, int first);
+void printBenchmarkRunEnd(uint64_t nodes, double seconds, double speedup, double efficiency, int json);
+void runBenchmark(int maxDepth, uint64_t maxNodes, int* rankCounts, int numRankCounts, int json, size_t distributedHashMegabytes);
+int analyzePosition(Board* board, int turn, int depth, Move* bestMove);
+int readLines(FILE* input, char lines[][BATCH_LINE_LENGTH], int maxLines);
+void analyzeLines(char lines[][BATCH_LINE_LENGTH], int count, int first, int step, int depth, AnalysisResult* results);
+void printAnalysis(char lines[][BATCH_LINE_LENGTH], int count, AnalysisResult* results);
+int runAnalysis(const char* path, int depth, int rank, int numProcesses);
+void initializeTablebaseIndex();
+uint64_t tablebaseIndex(Board* board, int turn);
+void loadTablebase(const char* path);
+int probeTablebase(Board* board, int turn, int* score);
+void loadBook(const char* path);
+int probeBook(Board* board, int turn, int move[4], int* score);
+int moveToKey(int move[4]);
+void keyToMove(int key, int move[4]);
+void orderMoves(Board* board, int turn, Move* moves, int numMoves, int ttMove, int depth);
+void countCutoff(int moveIndex);
+void recordCutoff(int turn, Move move, int depth, int remainingDepth, int moveIndex);
+void resetOrderingTables();
+void sumOrderingStats(uint64_t stats[2]);
+void printOrderingStats(uint64_t stats[2]);
+int isSearchAborted();
+int visitNode();
+void resetNodeCounts();
+uint64_t sumNodeCounts();
+#ifdef SEARCH_STATS
+double startSampledTimer(uint64_t calls);
+void stopSampledTimer(double start, uint64_t* total);
+void resetSearchStats();
+SearchStats sumSearchStats();
+void printSearchStats(SearchStats* total);
+#endif
+#ifdef PERF_COUNTERS
+int openPerfCounters();
+void closePerfCounters();
+int readPerfCounters(uint64_t counts[NUM_PERF_EVENTS]);
+int stopPerfCounters(uint64_t counts[NUM_PERF_EVENTS]);
+void printPerfCounters(uint64_t counts[NUM_PERF_EVENTS], int available, uint64_t nodes);
+#endif
+void initializeTrace(int threads);
+double traceBegin();
+void traceEnd(int kind, double start, int arg);
+int moveDigits(Move move);
+void writeTraceEvents(FILE* file, TraceEvent* events, int count, int process, int* first);
+void writeTrace(const char* path, int rank, int numProcesses);
+int quiescence(Board* board, int ply, int turn, int alpha, int beta);
+int minimax(Board* board, int maxDepth, int depth, int turn, int alpha, int beta);
+int parallelSearch(Board* board, int maxDepth, int depth, int turn, int alpha, int beta);
+int searchRootMove(Board* board, int turn, Move move, int maxDepth, int alpha);
+int searchJobs(Board* board, int turn, int maxDepth, int* fromRow, int* fromCol, int* toRow, int* toCol, int* score);
+int sendJob(int worker);
+void takeResult(int worker, int result[2]);
+void serveWorkers();
+int getBestMoveForOpponent(Board* board, int turn, int maxDepth, int* fromRow, int* fromCol, int* toRow, int* toCol, int* score, int rank, int numProcesses);
+int getTimedMoveForOpponent(Board* board, int turn, double timeBudget, int* fromRow, int* fromCol, int* toRow, int* toCol, int* score, int rank, int numProcesses);
 
 int main(int argc, char** argv) {
-	int board[BOARD_SIZE][BOARD_SIZE];
+	Board board;
 	int turn = PLAYER1;
-	int maxDepth;
+	double timeBudget;
 	int fromRow, fromCol, toRow, toCol;
 
-	initializeBoard(board);
+	// hybrid mode, one rank per node with a thread team searching its share of the work
+	// e.g. mpirun -np <nodes> --map-by node --bind-to none ./checkers_2 -threads <cores per node>
+	// only the thread that called MPI_Init_thread uses MPI, as thread 0 inside the parallel regions
+	int threadLevel;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadLevel);
+	searchCommunicator = MPI_COMM_WORLD;
+
+	// command line options
+	size_t hashMegabytes = DEFAULT_HASH_MB;
+	size_t distributedHashMegabytes = DEFAULT_DISTRIBUTED_HASH_MB;
+	int numThreads = 0; // 0 keeps the OpenMP default
+	const char* tablebasePath = NULL;
+	const char* bookPath = NULL;
+	int benchmarkDepth = 0; // 0 for no depth limit
+	uint64_t benchmarkNodes = 0; // 0 for no node limit, with both at 0 to play
+	const char* benchmarkRanks = NULL; // comma separated rank counts, NULL for powers of two
+	int json = 0;
+	int perfCounters = 0;
+	const char* tracePath = NULL; // NULL for no trace
+	int analysisDepth = 0; // 0 to play
+	const char* analysisPath = NULL;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-hash") == 0 && i + 1 < argc)
+			hashMegabytes = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-dhash") == 0 && i + 1 < argc)
+			distributedHashMegabytes = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			numThreads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-weights") == 0 && i + 1 < argc)
+			loadEvaluationWeights(argv[++i]);
+		else if (strcmp(argv[i], "-tb") == 0 && i + 1 < argc)
+			tablebasePath = argv[++i];
+		else if (strcmp(argv[i], "-book") == 0 && i + 1 < argc)
+			bookPath = argv[++i];
+		else if (strcmp(argv[i], "-bench") == 0 && i + 1 < argc)
+			benchmarkDepth = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-benchnodes") == 0 && i + 1 < argc)
+			benchmarkNodes = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-benchranks") == 0 && i + 1 < argc)
+			benchmarkRanks = argv[++i];
+		else if (strcmp(argv[i], "-json") == 0)
+			json = 1;
+		else if (strcmp(argv[i], "-perfcounters") == 0)
+			perfCounters = 1;
+		else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (strcmp(argv[i], "-analyze") == 0 && i + 2 < argc) {
+			analysisDepth = atoi(argv[++i]);
+			analysisPath = argv[++i];
+		}
+	}
+
+	// without thread support the rank must not run a thread team
+	if (threadLevel < MPI_THREAD_FUNNELED)
+		numThreads = 1;
 
-	MPI_Init(&argc, &argv);
+	if (numThreads > 0)
+		omp_set_num_threads(numThreads);
+
+	initializeMoveTables();
+	initializeZobrist();
+	initializeEvaluation();
+	initializeTranspositionTable(hashMegabytes);
+
+	// every rank maps the same file, the pages are shared by the ranks of a node
+	if (tablebasePath != NULL)
+		loadTablebase(tablebasePath);
+	if (bookPath != NULL)
+		loadBook(bookPath);
+	initializeBoard(&board);
 
 	int rank;
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -38,82 +561,198 @@ int main(int argc, char** argv) {
 	int numProcesses;
 	MPI_Comm_size(MPI_COMM_WORLD, &numProcesses);
 
+	// search the benchmark positions with each number of ranks instead of playing
+	if (benchmarkDepth > 0 || benchmarkNodes > 0) {
+		int rankCounts[MAX_BENCHMARK_RUNS];
+		int numRankCounts = (benchmarkRanks != NULL) ? parseCounts(benchmarkRanks, rankCounts, numProcesses)
+			: sweepCounts(numProcesses, rankCounts);
+		if (numRankCounts == 0 && rank == 0)
+			fprintf(stderr, "The rank counts are a comma separated list of up to %d ranks, e.g. 1,2,4\n", numProcesses);
+
+		if (tracePath != NULL) {
+			initializeTrace(omp_get_max_threads());
+			// the ranks start their clocks together
+			MPI_Barrier(MPI_COMM_WORLD);
+			traceStart = omp_get_wtime();
+		}
+		runBenchmark(benchmarkDepth, benchmarkNodes, rankCounts, numRankCounts, json, distributedHashMegabytes);
+		if (tracePath != NULL)
+			writeTrace(tracePath, rank, numProcesses);
+		free(transpositionTable);
+		MPI_Finalize();
+		return numRankCounts == 0;
+	}
+
+	// analyze a batch of positions instead of playing, the ranks search different positions
+	// so they keep their own tables without the distributed one
+	if (analysisDepth > 0) {
+		int read = runAnalysis(analysisPath, analysisDepth, rank, numProcesses);
+		free(transpositionTable);
+		MPI_Finalize();
+		return !read;
+	}
+
+	initializeDistributedTable(distributedHashMegabytes, numProcesses);
+
+	// each rank counts the hardware events of its own threads, the ranks without them count nothing
+#ifdef PERF_COUNTERS
+	if (perfCounters && openPerfCounters() == 0)
+		printf("Hardware counters are not available on rank %d, perf_event_paranoid or a virtual machine may not allow them\n", rank);
+#else
+	if (perfCounters && rank == 0)
+		printf("Hardware counters are only available on Linux\n");
+#endif
+
+	if (tracePath != NULL) {
+		initializeTrace(omp_get_max_threads());
+		// the ranks start their clocks together
+		MPI_Barrier(MPI_COMM_WORLD);
+		traceStart = omp_get_wtime();
+	}
+
 	if (rank == 0) {
-		printf("Enter the max depth to be searched: ");
+		if (threadLevel < MPI_THREAD_FUNNELED)
+			printf("The MPI library doesn't support threads, using one thread per rank\n");
+		printf("%d ranks with %d threads each\n", numProcesses, omp_get_max_threads());
+
+		printf("Enter the time budget per move in seconds: ");
 		fflush(stdout);
-		scanf("%d", &maxDepth);
+		scanf("%lf", &timeBudget);
 		getchar();
 
-		printBoard(board);
+		printBoard(&board);
 	}
 
-	MPI_Bcast(&maxDepth, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	MPI_Bcast(&timeBudget, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
 	// main game loop
-	while (!isGameOver(board)) {
+	while (!isGameOver(&board)) {
 		// my turn
 		if (turn == PLAYER1) {
-			if (rank == 0) {
-				if (getPlayerMove(board, turn, &fromRow, &fromCol, &toRow, &toCol)) {
-					makeMove(board, turn, fromRow, fromCol, toRow, toCol);
-					printBoard(board);
+			// only the key of the move goes to the other ranks, -1 if it was invalid
+			int key = -1;
 
-					turn = (turn == PLAYER1) ? PLAYER2 : PLAYER1;
+			if (rank == 0) {
+				if (getPlayerMove(&board, turn, &fromRow, &fromCol, &toRow, &toCol)) {
+					int move[4] = {fromRow, fromCol, toRow, toCol};
+					key = moveToKey(move);
 				} else {
 					printf("Invalid move. Try again.\n");
 				}
 			}
 
-			MPI_Bcast(&board, 64, MPI_INT, 0, MPI_COMM_WORLD);
-			MPI_Bcast(&turn, 1, MPI_INT, 0, MPI_COMM_WORLD);
+			double waitStart = traceBegin();
+			MPI_Bcast(&key, 1, MPI_INT, 0, MPI_COMM_WORLD);
+			traceEnd(TRACE_BROADCAST, waitStart, 0);
+
+			// every rank plays the move on its own copy of the game
+			if (key >= 0) {
+				int move[4];
+				keyToMove(key, move);
+				makeMove(&board, turn, createMove(&board, turn, move[0], move[1], move[2], move[3]));
+				if (rank == 0)
+					printBoard(&board);
+
+				turn = (turn == PLAYER1) ? PLAYER2 : PLAYER1;
+			}
 
 			// AI turn
 		}	else {
 			int score;
-			int scores[numProcesses];
-			int play = 0;
-
-			getBestMoveForOpponent(board, turn, maxDepth, &fromRow, &fromCol, &toRow, &toCol, &score, rank, numProcesses);
-			
-			MPI_Gather(&score, 1, MPI_INT, scores, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
+			resetTranspositionStats();
+			resetOrderingTables();
+#ifdef SEARCH_STATS
+			resetSearchStats();
+#endif
+#ifdef PERF_COUNTERS
+			uint64_t perfCounts[NUM_PERF_EVENTS];
+			uint64_t nodes = sumNodeCounts();
+			readPerfCounters(perfCounts);
+#endif
+
+			// the ranks have the same game and the same book, so all of them are in book or none is
+			int depth = 0, bookMove[4];
+			int inBook = probeBook(&board, turn, bookMove, &score);
+			if (inBook) {
+				fromRow = bookMove[0];
+				fromCol = bookMove[1];
+				toRow = bookMove[2];
+				toCol = bookMove[3];
+			} else {
+				depth = getTimedMoveForOpponent(&board, turn, timeBudget, &fromRow, &fromCol, &toRow, &toCol, &score, rank, numProcesses);
+			}
+#ifdef PERF_COUNTERS
+			int perfAvailable = stopPerfCounters(perfCounts);
+			nodes = sumNodeCounts() - nodes;
+#endif
+
+			// the highest score over all the ranks, MPI_MAXLOC takes the lowest move key on a tie
+			// rank 0 proposes the best move it collected and the workers the best move they got an exact score for
+			int move[4] = {fromRow, fromCol, toRow, toCol};
+			int proposed[2] = {score, moveToKey(move)};
+			int chosen[2];
+			double waitStart = traceBegin();
+			MPI_Allreduce(proposed, chosen, 1, MPI_2INT, MPI_MAXLOC, MPI_COMM_WORLD);
+			traceEnd(TRACE_REDUCE, waitStart, depth);
+
+			// every rank plays the move on its own copy of the game
+			keyToMove(chosen[1], move);
+			makeMove(&board, turn, createMove(&board, turn, move[0], move[1], move[2], move[3]));
 			if (rank == 0) {
-				int bestScore = -9999;
+				printf("Player 2(O) move: %d %d %d %d\n", move[0], move[1], move[2], move[3]);
+				if (inBook)
+					printf("Book move, score %d\n", score);
+				else
+					printf("Searched %d plies deep\n", depth);
+				printBoard(&board);
+			}
 
-				for (int i = 0; i < numProcesses; ++i) {
-					if (bestScore < scores[i]) {
-						bestScore = scores[i];
-						play = i;
-					}
-				}
-			} 
-				
-			MPI_Bcast(&play, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-			if (rank == play) {
-				makeMove(board, turn, fromRow, fromCol, toRow, toCol);
-				printf("Player 2(O) move: %d %d %d %d\n", fromRow, fromCol, toRow, toCol);
-				printBoard(board);
-				turn = (turn == PLAYER1) ? PLAYER2 : PLAYER1;
+			turn = (turn == PLAYER1) ? PLAYER2 : PLAYER1;
+
+			// each rank has its own table, report the sum over all of them
+			TTStats ttStats = sumTranspositionStats();
+			TTStats ttTotal;
+			MPI_Reduce(&ttStats, &ttTotal, 4, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+			uint64_t orderingStats[2], orderingTotal[2];
+			sumOrderingStats(orderingStats);
+			MPI_Reduce(orderingStats, orderingTotal, 2, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+			if (rank == 0) {
+				printTranspositionStats(&ttTotal);
+				printOrderingStats(orderingTotal);
 			}
+#ifdef SEARCH_STATS
+			// the counters are all 64 bit, the padding is zero
+			SearchStats searchStats = sumSearchStats();
+			SearchStats searchTotal;
+			MPI_Reduce(&searchStats, &searchTotal, sizeof(SearchStats) / sizeof(uint64_t), MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+			if (rank == 0)
+				printSearchStats(&searchTotal);
+#endif
+#ifdef PERF_COUNTERS
+			// an event is reported when every rank counted it
+			if (perfCounters) {
+				uint64_t perfTotal[NUM_PERF_EVENTS], nodesTotal;
+				int perfAllAvailable;
+				MPI_Reduce(perfCounts, perfTotal, NUM_PERF_EVENTS, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+				MPI_Reduce(&nodes, &nodesTotal, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+				MPI_Reduce(&perfAvailable, &perfAllAvailable, 1, MPI_INT, MPI_BAND, 0, MPI_COMM_WORLD);
+				if (rank == 0 && perfAllAvailable != 0)
+					printPerfCounters(perfTotal, perfAllAvailable, nodesTotal);
+			}
+#endif
 
-			MPI_Bcast(&board, 64, MPI_INT, play, MPI_COMM_WORLD);
-			MPI_Bcast(&turn, 1, MPI_INT, play, MPI_COMM_WORLD);
+			// the trace so far, written between searches so it doesn't change their timings
+			if (tracePath != NULL)
+				writeTrace(tracePath, rank, numProcesses);
 		}
 	}
 
 	if (rank == 0) {
 		// if game is over, check the winner
-		if (isGameOver(board)) {
-			int player1Pieces = 0, player2Pieces = 0;
-			for (int row = 0; row < BOARD_SIZE; ++row) {
-				for (int col = 0; col < BOARD_SIZE; ++col) {
-					if (board[row][col] == PLAYER1 || board[row][col] == PLAYER1 + 2)
-						player1Pieces++;
-					else if (board[row][col] == PLAYER2 || board[row][col] == PLAYER2 + 2)
-						player2Pieces++;
-				}
-			}
+		if (isGameOver(&board)) {
+			int player1Pieces = countPieces(&board, PLAYER1);
+			int player2Pieces = countPieces(&board, PLAYER2);
 
 			if (player1Pieces > player2Pieces)
 				printf("Player 1(X) wins!\n");
@@ -124,31 +763,339 @@ int main(int argc, char** argv) {
 		}
 	}
 
+#ifdef PERF_COUNTERS
+	closePerfCounters();
+#endif
+	free(transpositionTable);
+	freeDistributedTable();
+
 	MPI_Finalize();
 
 	return 0;
 }
 
+// index of the dark square at (row, col), -1 for light squares
+int squareIndex(int row, int col) {
+	if ((row + col) % 2 == 0) return -1;
+
+	return row * 4 + col / 2;
+}
+
+// row of a dark square
+int squareRow(int square) {
+	return square / 4;
+}
+
+// column of a dark square, odd on even rows and even on odd rows
+int squareCol(int square) {
+	return (square % 4) * 2 + ((square / 4) % 2 == 0 ? 1 : 0);
+}
+
+// get the content of a dark square in the same encoding used for the cells
+int getSquare(Board* board, int square) {
+	uint32_t bit = 1u << square;
+	int piece = EMPTY_CELL;
+
+	if (board->pieces[0] & bit)
+		piece = PLAYER1;
+	else if (board->pieces[1] & bit)
+		piece = PLAYER2;
+
+	// kings are stored as player + 2
+	if (piece != EMPTY_CELL && (board->kings & bit))
+		piece += 2;
+
+	return piece;
+}
+
+// set the content of a dark square, keeping the hash and the evaluation up to date
+void setSquare(Board* board, int square, int piece) {
+	uint32_t bit = 1u << square;
+	int oldPiece = getSquare(board, square);
+
+	board->hash ^= zobristPieces[oldPiece][square] ^ zobristPieces[piece][square];
+	board->score += pieceSquareTable[piece][square] - pieceSquareTable[oldPiece][square];
+
+	board->pieces[0] &= ~bit;
+	board->pieces[1] &= ~bit;
+	board->kings &= ~bit;
+
+	if (piece == EMPTY_CELL) return;
+
+	// kings are stored as player + 2
+	int player = (piece > PLAYER2) ? piece - 2 : piece;
+	board->pieces[player - 1] |= bit;
+	if (piece > PLAYER2)
+		board->kings |= bit;
+}
+
+// get the content of a cell, light cells are always empty
+int getCell(Board* board, int row, int col) {
+	int square = squareIndex(row, col);
+	if (square < 0) return EMPTY_CELL;
+
+	return getSquare(board, square);
+}
+
+// set the content of a dark cell
+void setCell(Board* board, int row, int col, int piece) {
+	int square = squareIndex(row, col);
+	if (square < 0) return;
+
+	setSquare(board, square, piece);
+}
+
+// count the pieces (men and kings) of a player
+int countPieces(Board* board, int turn) {
+	return __builtin_popcount(board->pieces[turn - 1]);
+}
+
+// fill the zobrist keys, with a fixed seed so every run (and every MPI rank) gets the same keys
+void initializeZobrist() {
+	uint64_t seed = 0x9E3779B97F4A7C15ull;
+
+	for (int piece = 0; piece < 5; ++piece) {
+		for (int square = 0; square < NUM_SQUARES; ++square) {
+			// xorshift64*
+			seed ^= seed >> 12;
+			seed ^= seed << 25;
+			seed ^= seed >> 27;
+			zobristPieces[piece][square] = (piece == EMPTY_CELL) ? 0 : seed * 0x2545F4914F6CDD1Dull;
+		}
+	}
+
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	zobristTurn = seed * 0x2545F4914F6CDD1Dull;
+}
+
+// compute the zobrist key of a board from scratch
+uint64_t computeHash(Board* board, int turn) {
+	uint64_t hash = (turn == PLAYER2) ? zobristTurn : 0;
+
+	for (int square = 0; square < NUM_SQUARES; ++square)
+		hash ^= zobristPieces[getSquare(board, square)][square];
+
+	return hash;
+}
+
+// allocate the transposition table, the number of entries is the largest power of two that fits
+void initializeTranspositionTable(size_t megabytes) {
+	size_t entries = 1;
+	while (entries * 2 * sizeof(TTEntry) <= megabytes * 1024 * 1024)
+		entries *= 2;
+
+	free(transpositionTable);
+	transpositionTable = calloc(entries, sizeof(TTEntry));
+	if (transpositionTable == NULL) {
+		fprintf(stderr, "Could not allocate a %zu MB transposition table\n", megabytes);
+		exit(1);
+	}
+
+	transpositionMask = entries - 1;
+}
+
+// read an entry of the table, other threads may be writing it
+TTEntry loadTransposition(TTEntry* slot) {
+	TTEntry entry;
+	entry.data = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+	entry.key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED);
+
+	return entry;
+}
+
+// check an entry against the position and the search window, as probeTransposition does
+int checkTransposition(TTEntry entry, uint64_t hash, int depth, int alpha, int beta, int* score, int* bestMove) {
+	TTStats* stats = &transpositionStats[omp_get_thread_num() % MAX_THREADS];
+	uint64_t data = entry.data;
+
+	stats->probes++;
+	*bestMove = 0;
+	if ((entry.key ^ data) != hash) return 0;
+
+	stats->hits++;
+	*score = (int16_t)(data & 0xFFFF);
+	*bestMove = (data >> 26) & 0x3FF;
+
+	int storedDepth = (data >> 16) & 0xFF;
+	int bound = (data >> 24) & 0x3;
+	if (storedDepth < depth) return 0;
+
+	if (bound == TT_EXACT || (bound == TT_LOWER && *score >= beta) || (bound == TT_UPPER && *score <= alpha)) {
+		stats->cutoffs++;
+		return 1;
+	}
+
+	return 0;
+}
+
+// look a position up in the transposition table
+// a position missing from the table of the rank is looked up in the distributed table
+// returns 1 when the stored result is deep enough to answer the search without searching,
+// the stored best move (0 for none) is returned in any case the position is found
+int probeTransposition(uint64_t hash, int depth, int alpha, int beta, int* score, int* bestMove) {
+	TTEntry* slot = &transpositionTable[hash & transpositionMask];
+	TTEntry entry = loadTransposition(slot);
+
+	if ((entry.key ^ entry.data) != hash && isDistributed(depth)) {
+		TTEntry remote = getDistributedEntry(hash);
+
+		// keep it in the local table for the next probes
+		if ((remote.key ^ remote.data) == hash) {
+			entry = remote;
+			writeTransposition(slot, hash, entry.data);
+		}
+	}
+
+	return checkTransposition(entry, hash, depth, alpha, beta, score, bestMove);
+}
+
+// data of an entry, the best move is packed as (from square << 5) | to square
+uint64_t packTransposition(int depth, int score, int bound, int bestMove) {
+	return (uint64_t)(uint16_t)score
+		| ((uint64_t)depth << 16)
+		| ((uint64_t)bound << 24)
+		| ((uint64_t)bestMove << 26)
+		| ((transpositionAge & 0xFFFFFF) << 40);
+}
+
+// write an entry, entries of the current search are only replaced by deeper or equal ones
+// returns 0 if the entry was kept
+int writeTransposition(TTEntry* slot, uint64_t hash, uint64_t data) {
+	uint64_t oldData = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+	int oldDepth = (oldData >> 16) & 0xFF;
+	uint64_t oldAge = oldData >> 40;
+	if (oldAge == (data >> 40) && oldDepth > (int)((data >> 16) & 0xFF)) return 0;
+
+	__atomic_store_n(&slot->key, hash ^ data, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->data, data, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+// store a search result, in the table of the rank and in the distributed table
+void storeTransposition(uint64_t hash, int depth, int score, int bound, int bestMove) {
+	uint64_t data = packTransposition(depth, score, bound, bestMove);
+
+	if (writeTransposition(&transpositionTable[hash & transpositionMask], hash, data))
+		transpositionStats[omp_get_thread_num() % MAX_THREADS].stores++;
+
+	if (isDistributed(depth))
+		putDistributedEntry(hash, data);
+}
+
+// allocate this rank's part of the distributed table, collective over the ranks of the search
+// with a single rank there is nothing to distribute and the table is not created
+void initializeDistributedTable(size_t megabytes, int numProcesses) {
+	if (numProcesses == 1) return;
+
+	size_t entries = 1;
+	while (entries * 2 * sizeof(TTEntry) <= megabytes * 1024 * 1024)
+		entries *= 2;
+
+	// displacements are counted in 64 bit words, two per entry
+	MPI_Win_allocate(entries * sizeof(TTEntry), sizeof(uint64_t), MPI_INFO_NULL, searchCommunicator, &distributedTable, &distributedWindow);
+	memset(distributedTable, 0, entries * sizeof(TTEntry));
+	MPI_Barrier(searchCommunicator);
+
+	// a single access epoch to every rank for the whole game, each operation is completed with a flush
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, distributedWindow);
+
+	distributedMask = entries - 1;
+	distributedRanks = numProcesses;
+}
+
+// release the distributed table, collective over the ranks of the search
+void freeDistributedTable() {
+	if (distributedRanks == 1) return;
+
+	MPI_Win_unlock_all(distributedWindow);
+	MPI_Win_free(&distributedWindow);
+	distributedRanks = 1;
+}
+
+// whether a result of this depth goes to the distributed table
+// only the thread that initialized MPI may use it (MPI_THREAD_FUNNELED), the others stay on the local table
+int isDistributed(int depth) {
+	return distributedRanks > 1 && depth >= DISTRIBUTED_MIN_DEPTH && omp_get_thread_num() == 0;
+}
+
+// read an entry of the distributed table from the rank that owns it
+TTEntry getDistributedEntry(uint64_t hash) {
+	int owner = hash % distributedRanks;
+	MPI_Aint index = (hash / distributedRanks) & distributedMask;
+	TTEntry entry;
+
+	// an atomic read, the owner may be getting an accumulate on the same entry
+	MPI_Get_accumulate(NULL, 0, MPI_UINT64_T, &entry, 2, MPI_UINT64_T, owner, index * 2, 2, MPI_UINT64_T, MPI_NO_OP, distributedWindow);
+	MPI_Win_flush(owner, distributedWindow);
+
+	return entry;
+}
+
+// write an entry of the distributed table to the rank that owns it, with the same replacement as the local table
+void putDistributedEntry(uint64_t hash, uint64_t data) {
+	int owner = hash % distributedRanks;
+	MPI_Aint index = (hash / distributedRanks) & distributedMask;
+
+	TTEntry entry = getDistributedEntry(hash);
+	if (!writeTransposition(&entry, hash, data)) return;
+
+	MPI_Accumulate(&entry, 2, MPI_UINT64_T, owner, index * 2, 2, MPI_UINT64_T, MPI_REPLACE, distributedWindow);
+	MPI_Win_flush(owner, distributedWindow);
+}
+
+// clear the transposition table counters
+void resetTranspositionStats() {
+	memset(transpositionStats, 0, sizeof(transpositionStats));
+}
+
+// sum the transposition table counters of all threads
+TTStats sumTranspositionStats() {
+	TTStats total = { 0, 0, 0, 0 };
+
+	for (int i = 0; i < MAX_THREADS; ++i) {
+		total.probes += transpositionStats[i].probes;
+		total.hits += transpositionStats[i].hits;
+		total.cutoffs += transpositionStats[i].cutoffs;
+		total.stores += transpositionStats[i].stores;
+	}
+
+	return total;
+}
+
+// print the transposition table counters
+void printTranspositionStats(TTStats* total) {
+	printf("Transposition table: %llu probes, %llu hits (%.1f%%), %llu cutoffs (%.1f%%), %llu stores\n",
+		(unsigned long long)total->probes, (unsigned long long)total->hits,
+		total->probes ? 100.0 * total->hits / total->probes : 0.0,
+		(unsigned long long)total->cutoffs, total->probes ? 100.0 * total->cutoffs / total->probes : 0.0,
+		(unsigned long long)total->stores);
+}
+
 // initializing the board
-void initializeBoard(int board[BOARD_SIZE][BOARD_SIZE]) {
+void initializeBoard(Board* board) {
+	board->pieces[0] = 0;
+	board->pieces[1] = 0;
+	board->kings = 0;
+	board->score = 0;
+	board->hash = 0;
+
 	for (int row = 0; row < BOARD_SIZE; ++row) {
 		for (int col = 0; col < BOARD_SIZE; ++col) {
 			if ((row + col) % 2 == 1) {
 				if (row < 3)
-					board[row][col] = PLAYER2; // player 1 pieces
+					setCell(board, row, col, PLAYER2); // player 1 pieces
 				else if (row > BOARD_SIZE - 4)
-					board[row][col] = PLAYER1; // player 2 pieces
-				else
-					board[row][col] = EMPTY_CELL; // empty
-			} else {
-				board[row][col] = EMPTY_CELL; // empty
+					setCell(board, row, col, PLAYER1); // player 2 pieces
 			}
 		}
 	}
 }
 
 // printing the board
-void printBoard(int board[BOARD_SIZE][BOARD_SIZE]) {
+void printBoard(Board* board) {
 	printf("\n");
 	printf("    ");
 	for (int col = 0; col < BOARD_SIZE; ++col) {
@@ -160,50 +1107,66 @@ void printBoard(int board[BOARD_SIZE][BOARD_SIZE]) {
 	for (int col = 0; col < BOARD_SIZE; ++col) {
 		printf("----");
 	}
-    
+
 	printf("\n");
 
 	for (int row = 0; row < BOARD_SIZE; ++row) {
 		printf("  %d ", row);
 
 		for (int col = 0; col < BOARD_SIZE; ++col) {
+			int cell = getCell(board, row, col);
+
 			// player 1 piece
-			if (board[row][col] == PLAYER1) {
+			if (cell == PLAYER1) {
 				printf("| x ");
 			// player 2 piece
-			} else if (board[row][col] == PLAYER2) {
+			} else if (cell == PLAYER2) {
 				printf("| o ");
 			// player 1 king
-			} else if (board[row][col] == PLAYER1 + 2) {
+			} else if (cell == PLAYER1 + 2) {
 				printf("| X ");
 			// player 2 king
-			} else if (board[row][col] == PLAYER2 + 2) {
+			} else if (cell == PLAYER2 + 2) {
 				printf("| O ");
 			// empty cell
 			} else {
 				printf("|   ");
 			}
 		}
-    
+
 		printf("|\n    ");
 
 		for (int col = 0; col < BOARD_SIZE; ++col) {
 			printf("----");
 		}
-			
+
 		printf("\n");
 	}
 
 	printf("\n");
 }
 
-// create a copy of the board
-void copyBoard(int src[BOARD_SIZE][BOARD_SIZE], int dest[BOARD_SIZE][BOARD_SIZE]) {
-	for (int row = 0; row < BOARD_SIZE; ++row) {
-		for (int col = 0; col < BOARD_SIZE; ++col) {
-			dest[row][col] = src[row][col];
-		}
+// read a position written as the 32 dark squares from row 0 to row 7, each one of . x o X O
+// as printBoard shows them, and the player to move as 1 or 2
+// returns 0 if the text is not a position
+int parsePosition(const char* squares, const char* player, Board* board, int* turn) {
+	const char* pieces = ".xoXO";
+
+	if (strlen(squares) != NUM_SQUARES || (strcmp(player, "1") != 0 && strcmp(player, "2") != 0)) return 0;
+
+	Board parsed = { { 0, 0 }, 0, 0, 0 };
+	for (int square = 0; square < NUM_SQUARES; ++square) {
+		const char* piece = strchr(pieces, squares[square]);
+		if (piece == NULL) return 0;
+
+		setSquare(&parsed, square, piece - pieces);
 	}
+
+	*turn = atoi(player);
+	parsed.hash = computeHash(&parsed, *turn);
+	*board = parsed;
+
+	return 1;
 }
 
 // check if not within the bounds of the board
@@ -212,15 +1175,17 @@ int isNotWithinBounds(int toRow, int toCol) {
 }
 
 // check if a move is valid
-int isValidMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int fromRow, int fromCol, int toRow, int toCol) {
+int isValidMove(Board* board, int turn, int fromRow, int fromCol, int toRow, int toCol) {
 	// check if the destination is within the bounds of the board
 	if (isNotWithinBounds(toRow, toCol)) return 0;
 
-	// check if the cell selected not is empty
-	if (board[fromRow][fromCol] == EMPTY_CELL) return 0;
+	int fromCell = getCell(board, fromRow, fromCol);
+
+	// check if the cell selected holds one of the player's own pieces
+	if (fromCell != turn && fromCell != turn + 2) return 0;
 
 	// check if the destination is empty
-	if (board[toRow][toCol] != EMPTY_CELL) return 0;
+	if (getCell(board, toRow, toCol) != EMPTY_CELL) return 0;
 
 	// check if the piece is moving diagonally
 	int rowDiff = abs(toRow - fromRow);
@@ -228,7 +1193,7 @@ int isValidMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int fromRow, int fr
 	if (rowDiff == 0 || colDiff == 0 || rowDiff != colDiff) return 0;
 
 	// check if is a king move
-	int isKing = (board[fromRow][fromCol] == turn + 2) ? 1 : 0;
+	int isKing = (fromCell == turn + 2) ? 1 : 0;
 
 	// check if the piece is moving in the correct direction
 	int direction = (turn == PLAYER1) ? -1 : 1;
@@ -241,20 +1206,15 @@ int isValidMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int fromRow, int fr
 
 	// if it is a capture move, check if the opponent piece is in the middle
 	if (distance == 2 && !isKing) {
-		int midRow = (fromRow + toRow) / 2;
-		int midCol = (fromCol + toCol) / 2;
+		int midCell = getCell(board, (fromRow + toRow) / 2, (fromCol + toCol) / 2);
 
 		// check if the middle cell contains an opponent's piece or opponent king
-		if (board[midRow][midCol] == turn || board[midRow][midCol] == turn + 2 || board[midRow][midCol] == EMPTY_CELL)
+		if (midCell == turn || midCell == turn + 2 || midCell == EMPTY_CELL)
 			return 0;
 	}
 
 	// check for conditions if it is a king piece
 	if (isKing) {
-		int rowDiff = abs(toRow - fromRow);
-		int colDiff = abs(toCol - fromCol);
-		if (rowDiff != colDiff) return 0;
-
 		// check if the path is clear for a king move
 		int i, row, col;
 		int rowDir = (toRow - fromRow) / rowDiff; // 1 or -1
@@ -262,64 +1222,99 @@ int isValidMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int fromRow, int fr
 		for (i = 1; i < rowDiff - 1; i++) {
 			row = fromRow + i * rowDir;
 			col = fromCol + i * colDir;
-			if (board[row][col] != EMPTY_CELL) return 0;
+			if (getCell(board, row, col) != EMPTY_CELL) return 0;
 		}
 	}
 
 	return 1; // move is valid
 }
- 
+
+// pack a valid move given by its cells, for the moves that don't come from the generator
+Move createMove(Board* board, int turn, int fromRow, int fromCol, int toRow, int toCol) {
+	int from = squareIndex(fromRow, fromCol);
+	int isKing = (board->kings & (1u << from)) ? 1 : 0;
+	Move move = (from << 5) | squareIndex(toRow, toCol);
+
+	// the captured cell is the middle one for men and the one behind the destination for kings
+	int capturedSquare = -1;
+	if (abs(toRow - fromRow) == 2 && !isKing) {
+		capturedSquare = squareIndex((fromRow + toRow) / 2, (fromCol + toCol) / 2);
+	} else if (abs(toRow - fromRow) > 1 && isKing) {
+		int rowDir = (toRow > fromRow) ? 1 : -1;
+		int colDir = (toCol > fromCol) ? 1 : -1;
+		capturedSquare = squareIndex(toRow - rowDir, toCol - colDir);
+	}
+
+	if (capturedSquare >= 0 && getSquare(board, capturedSquare) != EMPTY_CELL)
+		move |= MOVE_CAPTURE | (capturedSquare << MOVE_CAPTURED_SHIFT);
+
+	if (!isKing && ((turn == PLAYER1 && toRow == 0) || (turn == PLAYER2 && toRow == BOARD_SIZE - 1)))
+		move |= MOVE_PROMOTION;
+
+	return move;
+}
+
 // function to update the board after a valid move
-void makeMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int fromRow, int fromCol, int toRow, int toCol) {
-	int isKing = (board[fromRow][fromCol] == turn + 2) ? 1 : 0;
+// returns what is needed to take the move back with unmakeMove
+MoveUndo makeMove(Board* board, int turn, Move move) {
+	MoveUndo undo;
+	undo.from = (move >> 5) & 31;
+	undo.to = move & 31;
 
-	// move the piece to the destination cell
-	board[toRow][toCol] = board[fromRow][fromCol];
-	board[fromRow][fromCol] = EMPTY_CELL;
+	uint32_t fromBit = 1u << undo.from;
+	uint32_t toBit = 1u << undo.to;
+	int side = turn - 1;
+	int isKing = (board->kings & fromBit) ? 1 : 0;
 
-	// check if the piece should be promoted to a king
-	if ((turn == PLAYER1 && toRow == 0) || (turn == PLAYER2 && toRow == BOARD_SIZE - 1)) {
-		// check if the piece is not already a king before promoting it
+	// the moving piece must belong to the player to move
+	assert(board->pieces[side] & fromBit);
 
-		if (board[toRow][toCol] == PLAYER1 || board[toRow][toCol] == PLAYER2) {
-			board[toRow][toCol] += 2; // promote the piece to a king
-		}
-	}
+	undo.movedPiece = isKing ? turn + 2 : turn;
+	undo.promoted = (move & MOVE_PROMOTION) ? 1 : 0;
 
-	// if it is a capture move, remove the captured piece
-	if (abs(toRow - fromRow) == 2 && !isKing) {
-		int midRow = (fromRow + toRow) / 2;
-		int midCol = (fromCol + toCol) / 2;
-		board[midRow][midCol] = EMPTY_CELL;
+	// move the piece to the destination cell
+	board->pieces[side] = (board->pieces[side] & ~fromBit) | toBit;
+	if (isKing)
+		board->kings = (board->kings & ~fromBit) | toBit;
+
+	// promote the piece to a king
+	if (undo.promoted)
+		board->kings |= toBit;
+
+	// the other player is to move now
+	board->hash ^= zobristPieces[undo.movedPiece][undo.from] ^ zobristPieces[undo.movedPiece + 2 * undo.promoted][undo.to] ^ zobristTurn;
+	board->score += pieceSquareTable[undo.movedPiece + 2 * undo.promoted][undo.to] - pieceSquareTable[undo.movedPiece][undo.from];
+
+	undo.capturedSquare = -1;
+	undo.capturedPiece = EMPTY_CELL;
+
+	// remove the captured piece
+	if (move & MOVE_CAPTURE) {
+		undo.capturedSquare = move >> MOVE_CAPTURED_SHIFT;
+		undo.capturedPiece = getSquare(board, undo.capturedSquare);
+		setSquare(board, undo.capturedSquare, EMPTY_CELL);
 	}
 
-	// capture move for a king piece
-	if (isKing) {
-		int rowDiff = abs(toRow - fromRow);
-		int colDiff = abs(toCol - fromCol);
+	return undo;
+}
 
-		// check if the path is clear for a king move
-		int rowDir = (toRow - fromRow) / rowDiff; // 1 or -1
-		int colDir = (toCol - fromCol) / colDiff; // 1 or -1
-		board[toRow-rowDir][toCol-colDir] = EMPTY_CELL;
-	}
+// take back a move done by makeMove, restoring the board in place
+void unmakeMove(Board* board, MoveUndo undo) {
+	// the destination is empty again and the piece goes back as it was before any promotion
+	setSquare(board, undo.to, EMPTY_CELL);
+	setSquare(board, undo.from, undo.movedPiece);
+
+	// put back the captured piece
+	if (undo.capturedSquare >= 0)
+		setSquare(board, undo.capturedSquare, undo.capturedPiece);
+
+	board->hash ^= zobristTurn;
 }
 
 // check if the game has ended
-int isGameOver(int board[BOARD_SIZE][BOARD_SIZE]) {
-	// check if a player has lost all their pieces
-	int player1Pieces = 0, player2Pieces = 0;
-	for (int row = 0; row < BOARD_SIZE; ++row) {
-		for (int col = 0; col < BOARD_SIZE; ++col) {
-			if (board[row][col] == PLAYER1 || board[row][col] == PLAYER1 + 2)
-				player1Pieces++;
-			else if (board[row][col] == PLAYER2 || board[row][col] == PLAYER2 + 2)
-				player2Pieces++;
-			}
-	}
-
+int isGameOver(Board* board) {
 	// if a player has no pieces the game is over
-	if (player1Pieces == 0 || player2Pieces == 0) return 1;
+	if (board->pieces[0] == 0 || board->pieces[1] == 0) return 1;
 
 	// check for stalemate, if so it is a draw
 	if (!hasValidMoves(board, PLAYER1) || !hasValidMoves(board, PLAYER2)) {
@@ -330,7 +1325,7 @@ int isGameOver(int board[BOARD_SIZE][BOARD_SIZE]) {
 }
 
 // function to prompt the player for their move and validate the input
-int getPlayerMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int* fromRow, int* fromCol, int* toRow, int* toCol) {
+int getPlayerMove(Board* board, int turn, int* fromRow, int* fromCol, int* toRow, int* toCol) {
 	if (turn == PLAYER1) {
 		printf("Player 1(X) turn:\n");
 	} else {
@@ -359,210 +1354,1806 @@ int getPlayerMove(int board[BOARD_SIZE][BOARD_SIZE], int turn, int* fromRow, int
 }
 
 // check if a player has any valid moves left
-int hasValidMoves(int board[BOARD_SIZE][BOARD_SIZE], int turn) {
-	// loop through the board and find all possible moves for the current player
-	for (int fromRow = 0; fromRow < BOARD_SIZE; ++fromRow) {
-		for (int fromCol = 0; fromCol < BOARD_SIZE; ++fromCol) {
-			if (board[fromRow][fromCol] == turn || board[fromRow][fromCol] == turn + 2) {
-				for (int toRow = 0; toRow < BOARD_SIZE; ++toRow) {
-					for (int toCol = 0; toCol < BOARD_SIZE; ++toCol) {
-						if (isValidMove(board, turn, fromRow, fromCol, toRow, toCol)) {
-							return 1; // found a valid move
-						}
-					}
-				}
-			}
+int hasValidMoves(Board* board, int turn) {
+	int numMoves = 0;
+	getPossibleMoves(board, turn, &numMoves);
+	releaseMoves(numMoves);
+
+	return numMoves > 0;
+}
+
+// precompute the neighbor and jump squares of every dark square
+void initializeMoveTables() {
+	int rowDirs[4] = { -1, -1, 1, 1 };
+	int colDirs[4] = { -1, 1, -1, 1 };
+
+	for (int square = 0; square < NUM_SQUARES; ++square) {
+		int row = squareRow(square), col = squareCol(square);
+
+		for (int dir = 0; dir < 4; ++dir) {
+			int stepRow = row + rowDirs[dir], stepCol = col + colDirs[dir];
+			int jumpRow = row + 2 * rowDirs[dir], jumpCol = col + 2 * colDirs[dir];
+
+			neighborSquare[square][dir] = isNotWithinBounds(stepRow, stepCol) ? -1 : squareIndex(stepRow, stepCol);
+			jumpSquare[square][dir] = isNotWithinBounds(jumpRow, jumpCol) ? -1 : squareIndex(jumpRow, jumpCol);
 		}
 	}
+}
+
+// push a move on the move stack of the thread, the target is the destination square with the flags
+void addMove(MoveStack* stack, int from, Move target) {
+	if (stack->top == MOVE_STACK_SIZE) {
+		fprintf(stderr, "The move stack is full, raise MOVE_STACK_SIZE\n");
+		exit(1);
+	}
 
-	return 0; // no valid moves
+	stack->moves[stack->top++] = (from << 5) | target;
 }
 
-// generate all possible moves for a player
-void getPossibleMoves(int board[BOARD_SIZE][BOARD_SIZE], int turn, int possibleMoves[100][4], int* numMoves) {
-	*numMoves = 0;
+// give back the last move list taken by the thread
+void releaseMoves(int numMoves) {
+	moveStacks[omp_get_thread_num() % MAX_THREADS].top -= numMoves;
+}
 
-	// loop through the board and find all possible moves for the current player
-	#pragma omp parallel for collapse(2)
-	for (int fromRow = 0; fromRow < BOARD_SIZE; ++fromRow) {
-		for (int fromCol = 0; fromCol < BOARD_SIZE; ++fromCol) {
-			if (board[fromRow][fromCol] == turn || board[fromRow][fromCol] == turn + 2) {
-				#pragma omp parallel for collapse(2)
-				for (int toRow = 0; toRow < BOARD_SIZE; ++toRow) {
-					for (int toCol = 0; toCol < BOARD_SIZE; ++toCol) {
-						if (isValidMove(board, turn, fromRow, fromCol, toRow, toCol)) {
-							// add the move to the list of possible moves
-							possibleMoves[*numMoves][0] = fromRow;
-							possibleMoves[*numMoves][1] = fromCol;
-							possibleMoves[*numMoves][2] = toRow;
-							possibleMoves[*numMoves][3] = toCol;
-							(*numMoves)++;
-						}
-					}
+// generate all possible moves for a player, on top of the move stack of the thread
+// the moves come out in the same order as a scan of the board would find them
+// returns the first of them, the list must be released with releaseMoves
+Move* getPossibleMoves(Board* board, int turn, int* numMoves) {
+	int thread = omp_get_thread_num() % MAX_THREADS;
+	MoveStack* stack = &moveStacks[thread];
+	int first = stack->top;
+#ifdef SEARCH_STATS
+	SearchStats* stats = &searchStats[thread];
+	double start = startSampledTimer(stats->generations++);
+#endif
+	uint32_t occupied = board->pieces[0] | board->pieces[1];
+	uint32_t opponent = board->pieces[2 - turn];
+	uint32_t crownRow = (turn == PLAYER1) ? PLAYER2_BACK_RANK_MASK : PLAYER1_BACK_RANK_MASK;
+
+	for (uint32_t pieces = board->pieces[turn - 1]; pieces; pieces &= pieces - 1) {
+		int from = __builtin_ctz(pieces);
+
+		if (board->kings & (1u << from)) {
+			// a king slides over empty squares and may jump the first piece it meets
+			int targets[4][BOARD_SIZE];
+
+			for (int dir = 0; dir < 4; ++dir) {
+				int distance = 1;
+				int square = neighborSquare[from][dir];
+
+				for (int i = 0; i < BOARD_SIZE; ++i)
+					targets[dir][i] = -1;
+
+				while (square >= 0 && !(occupied & (1u << square))) {
+					targets[dir][distance++] = square;
+					square = neighborSquare[square][dir];
+				}
+
+				if (square >= 0) {
+					int landing = neighborSquare[square][dir];
+					if (landing >= 0 && !(occupied & (1u << landing)))
+						targets[dir][distance + 1] = landing | MOVE_CAPTURE | (square << MOVE_CAPTURED_SHIFT);
 				}
 			}
-		}
-	}
-}
 
-// evaluate the board position
-int evaluatePosition(int board[BOARD_SIZE][BOARD_SIZE]) {
-	int player1Pieces = 0, player2Pieces = 0;
-	int player1Kings = 0, player2Kings = 0;
+			// rows above the king from the farthest, then rows below from the nearest
+			for (int distance = BOARD_SIZE - 1; distance > 0; --distance) {
+				if (targets[UP_LEFT][distance] >= 0) addMove(stack, from, targets[UP_LEFT][distance]);
+				if (targets[UP_RIGHT][distance] >= 0) addMove(stack, from, targets[UP_RIGHT][distance]);
+			}
+			for (int distance = 1; distance < BOARD_SIZE; ++distance) {
+				if (targets[DOWN_LEFT][distance] >= 0) addMove(stack, from, targets[DOWN_LEFT][distance]);
+				if (targets[DOWN_RIGHT][distance] >= 0) addMove(stack, from, targets[DOWN_RIGHT][distance]);
+			}
+		} else {
+			// men only move forward, player 1 up the board and player 2 down
+			int firstDir = (turn == PLAYER1) ? UP_LEFT : DOWN_LEFT;
+			int stepIndex = 0, jumpIndex = 0;
+			Move steps[2], jumps[2];
 
-	int score = 0;
+			for (int dir = firstDir; dir < firstDir + 2; ++dir) {
+				int step = neighborSquare[from][dir];
+				int jump = jumpSquare[from][dir];
 
-	// count pieces and calculate score
-	for (int row = 0; row < BOARD_SIZE; row++) {
-		for (int col = 0; col < BOARD_SIZE; col++) {
-			// score for normal pieces
-			if (board[row][col] == PLAYER2) {
-				player2Pieces++;
-				score += 100;
-			} else if (board[row][col] == PLAYER1) {
-				player1Pieces++;
-				score -= 100;
-				// more score for king pieces
-			} else if (board[row][col] == PLAYER2 + 2) {
-				player2Kings++;
-				score += 300;
-			} else if (board[row][col] == PLAYER1 + 2) {
-				player1Kings++;
-				score -= 300;
+				if (step >= 0 && !(occupied & (1u << step)))
+					steps[stepIndex++] = step | ((crownRow & (1u << step)) ? MOVE_PROMOTION : 0);
+
+				if (jump >= 0 && (opponent & (1u << step)) && !(occupied & (1u << jump)))
+					jumps[jumpIndex++] = jump | MOVE_CAPTURE | (step << MOVE_CAPTURED_SHIFT) | ((crownRow & (1u << jump)) ? MOVE_PROMOTION : 0);
 			}
 
-			// higher score for controlling the center of the board (rows 3-4 and columns 2-5)
-			// block me from going into the center
-			if (row >= 3 && row <= 4 && col >= 2 && col <= 5) {
-				if (board[row][col] == PLAYER2)
-					score += 50;
-				else if (board[row][col] == PLAYER1)
-					score -= 50;
-				else if (board[row][col] == PLAYER2 + 2)
-					score += 100;
-				else if (board[row][col] == PLAYER1 + 2)
-					score -= 100;
+			// jumps land on the farther row, so they come first going up and last going down
+			if (turn == PLAYER1)
+				for (int i = 0; i < jumpIndex; ++i) addMove(stack, from, jumps[i]);
+			for (int i = 0; i < stepIndex; ++i) addMove(stack, from, steps[i]);
+			if (turn == PLAYER2)
+				for (int i = 0; i < jumpIndex; ++i) addMove(stack, from, jumps[i]);
+		}
+	}
+
+	*numMoves = stack->top - first;
+#ifdef SEARCH_STATS
+	stats->movesGenerated += *numMoves;
+	stopSampledTimer(start, &stats->generationTime);
+#endif
+	return &stack->moves[first];
+}
+
+// generate only the moves that change the material: captures of the opponent's pieces,
+// then steps of men to the row where they are crowned
+// kings only look for the first piece in each direction, without listing the squares before it
+// returns the first of them, the list must be released with releaseMoves
+Move* getCaptureMoves(Board* board, int turn, int* numMoves) {
+	int thread = omp_get_thread_num() % MAX_THREADS;
+	MoveStack* stack = &moveStacks[thread];
+	int first = stack->top;
+#ifdef SEARCH_STATS
+	SearchStats* stats = &searchStats[thread];
+	double start = startSampledTimer(stats->captureGenerations++);
+#endif
+	uint32_t occupied = board->pieces[0] | board->pieces[1];
+	uint32_t opponent = board->pieces[2 - turn];
+	uint32_t men = board->pieces[turn - 1] & ~board->kings;
+	uint32_t crownRow = (turn == PLAYER1) ? PLAYER2_BACK_RANK_MASK : PLAYER1_BACK_RANK_MASK;
+	int firstDir = (turn == PLAYER1) ? UP_LEFT : DOWN_LEFT;
+
+	for (uint32_t kings = board->pieces[turn - 1] & board->kings; kings; kings &= kings - 1) {
+		int from = __builtin_ctz(kings);
+
+		for (int dir = 0; dir < 4; ++dir) {
+			int square = neighborSquare[from][dir];
+			while (square >= 0 && !(occupied & (1u << square)))
+				square = neighborSquare[square][dir];
+
+			if (square >= 0 && (opponent & (1u << square))) {
+				int landing = neighborSquare[square][dir];
+				if (landing >= 0 && !(occupied & (1u << landing)))
+					addMove(stack, from, landing | MOVE_CAPTURE | (square << MOVE_CAPTURED_SHIFT));
 			}
 		}
 	}
 
-	// add score for having more pieces and kings
-	// and make it capture pieces and kings
-	score += 10 * (player2Pieces + player2Kings - player1Pieces - player1Kings);
-	//score += player2Pieces - player1Pieces + (0.5 * player2Kings - 0.5 * player1Kings);
+	for (uint32_t pieces = men; pieces; pieces &= pieces - 1) {
+		int from = __builtin_ctz(pieces);
 
-	return score;
-}
+		for (int dir = firstDir; dir < firstDir + 2; ++dir) {
+			int step = neighborSquare[from][dir];
+			int jump = jumpSquare[from][dir];
 
-// minimax with alpha-beta prunning
-int minimax(int board[BOARD_SIZE][BOARD_SIZE], int maxDepth, int depth, int turn, int alpha, int beta) {
-	// when max depth is reached, start evaluating the position
-	if (depth == maxDepth) {
-		return evaluatePosition(board);
+			if (jump >= 0 && (opponent & (1u << step)) && !(occupied & (1u << jump)))
+				addMove(stack, from, jump | MOVE_CAPTURE | (step << MOVE_CAPTURED_SHIFT) | ((crownRow & (1u << jump)) ? MOVE_PROMOTION : 0));
+		}
 	}
 
-	// get the posible moves for this position
-	int moves[100][4];
-	int numMoves = 0;
-	getPossibleMoves(board, turn, moves, &numMoves);
-	
-	// AI turn,  max the score
-	if (turn == PLAYER2) { 
-		int maxScore = -9999;
+	// the men one step away from being crowned
+	for (uint32_t pieces = men; pieces; pieces &= pieces - 1) {
+		int from = __builtin_ctz(pieces);
 
-		// for each of the possible moves, call minimax again
-		for (int i = 0; i < numMoves; i++) {
-			int fromRow = moves[i][0], fromCol = moves[i][1];
-			int toRow = moves[i][2], toCol = moves[i][3];
-			
-			int boardCopy[BOARD_SIZE][BOARD_SIZE];
-			copyBoard(board, boardCopy);
+		for (int dir = firstDir; dir < firstDir + 2; ++dir) {
+			int step = neighborSquare[from][dir];
+
+			if (step >= 0 && (crownRow & (1u << step)) && !(occupied & (1u << step)))
+				addMove(stack, from, step | MOVE_PROMOTION);
+		}
+	}
 
-			makeMove(boardCopy, turn, fromRow, fromCol, toRow, toCol);
-			int score = minimax(boardCopy, maxDepth, depth + 1, PLAYER1, alpha, beta);
+	*numMoves = stack->top - first;
+#ifdef SEARCH_STATS
+	stopSampledTimer(start, &stats->generationTime);
+#endif
+	return &stack->moves[first];
+}
 
-			if (score > maxScore)
-				maxScore = score;
+// read evaluation weights from a file of "name value" lines, the terms not in the file keep their weight
+// must be called before initializeEvaluation
+void loadEvaluationWeights(const char* path) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Could not open the weights file %s\n", path);
+		exit(1);
+	}
 
-			if (maxScore > alpha)
-				alpha = maxScore;
+	char name[64];
+	int weight;
+	while (fscanf(file, "%63s %d", name, &weight) == 2) {
+		int term = 0;
+		while (term < NUM_TERMS && strcmp(name, evaluationTermNames[term]) != 0)
+			term++;
 
-			// beta prunning
-			if (beta <= alpha) break;
+		if (term == NUM_TERMS) {
+			fprintf(stderr, "Unknown evaluation term %s in %s\n", name, path);
+			exit(1);
 		}
 
-		return maxScore;
-		// my turn, min the score
-	} else { 
-		int minScore = 9999;
+		evaluationWeights[term] = weight;
+	}
 
-		// for each of the possible moves, call minimax again
-		for (int i = 0; i < numMoves; i++) {
-			int fromRow = moves[i][0], fromCol = moves[i][1];
-			int toRow = moves[i][2], toCol = moves[i][3];
-			
-			int boardCopy[BOARD_SIZE][BOARD_SIZE];
-			copyBoard(board, boardCopy);
+	fclose(file);
+}
 
-			makeMove(boardCopy, turn, fromRow, fromCol, toRow, toCol);
-			int score = minimax(boardCopy, maxDepth, depth + 1, PLAYER2, alpha, beta);
+// fill the piece square table from the weights, with the features of a board holding a single piece
+void initializeEvaluation() {
+	for (int piece = PLAYER1; piece <= PLAYER2 + 2; ++piece) {
+		for (int square = 0; square < NUM_SQUARES; ++square) {
+			Board board = { { 0, 0 }, 0, 0, 0 };
+			board.pieces[(piece - 1) % 2] = 1u << square;
+			if (piece > PLAYER2)
+				board.kings = 1u << square;
 
-			if (score < minScore)
-				minScore = score;
+			int features[NUM_TERMS];
+			countFeatures(&board, features);
 
-			if (minScore < beta)
-				beta = minScore;
+			// the mobility depends on the other pieces, evaluatePosition adds it
+			features[TERM_MOBILITY] = 0;
 
-			if (beta <= alpha) break;
-		}
+			int score = 0;
+			for (int term = 0; term < NUM_TERMS; ++term)
+				score += evaluationWeights[term] * features[term];
 
-		return minScore;
+			pieceSquareTable[piece][square] = score;
+		}
 	}
 }
 
-// get the best move for the AI opponent
-int getBestMoveForOpponent(int board[BOARD_SIZE][BOARD_SIZE], int turn, int maxDepth, int* fromRow, int* fromCol, int* toRow, int* toCol, int* score, int rank, int numProcesses) {
-	// get move possible moves to pick
-	int moves[100][4];
-	int numMoves = 0;
-	getPossibleMoves(board, turn, moves, &numMoves);
+// count the moves without captures of a player, with shifts over the packed board
+// (one for each empty square a piece could step to, kings only count their first square)
+int countMobility(Board* board, int turn) {
+	uint32_t empty = ~(board->pieces[0] | board->pieces[1]);
+	uint32_t pieces = board->pieces[turn - 1];
+
+	// pieces moving to higher rows (square + 3, 4 or 5) and to lower ones (square - 3, 4 or 5)
+	uint32_t down = (turn == PLAYER2) ? pieces : pieces & board->kings;
+	uint32_t up = (turn == PLAYER1) ? pieces : pieces & board->kings;
+
+	return __builtin_popcount((down << 4) & empty)
+		+ __builtin_popcount(((down & EVEN_ROWS_MASK & ~RIGHT_EDGE_MASK) << 5) & empty)
+		+ __builtin_popcount(((down & ~EVEN_ROWS_MASK & ~LEFT_EDGE_MASK) << 3) & empty)
+		+ __builtin_popcount((up >> 4) & empty)
+		+ __builtin_popcount(((up & ~EVEN_ROWS_MASK & ~LEFT_EDGE_MASK) >> 5) & empty)
+		+ __builtin_popcount(((up & EVEN_ROWS_MASK & ~RIGHT_EDGE_MASK) >> 3) & empty);
+}
+
+// count the evaluation terms of a position, PLAYER2 minus PLAYER1
+void countFeatures(Board* board, int features[NUM_TERMS]) {
+	uint32_t player1Men = board->pieces[0] & ~board->kings;
+	uint32_t player2Men = board->pieces[1] & ~board->kings;
+	uint32_t player1Kings = board->pieces[0] & board->kings;
+	uint32_t player2Kings = board->pieces[1] & board->kings;
+
+	features[TERM_MAN] = __builtin_popcount(player2Men) - __builtin_popcount(player1Men);
+	features[TERM_KING] = __builtin_popcount(player2Kings) - __builtin_popcount(player1Kings);
+	features[TERM_MAN_CENTER] = __builtin_popcount(player2Men & CENTER_MASK) - __builtin_popcount(player1Men & CENTER_MASK);
+	features[TERM_KING_CENTER] = __builtin_popcount(player2Kings & CENTER_MASK) - __builtin_popcount(player1Kings & CENTER_MASK);
+	features[TERM_PIECE] = countPieces(board, PLAYER2) - countPieces(board, PLAYER1);
+	features[TERM_BACK_RANK] = __builtin_popcount(player2Men & PLAYER2_BACK_RANK_MASK) - __builtin_popcount(player1Men & PLAYER1_BACK_RANK_MASK);
+	features[TERM_RUNAWAY] = __builtin_popcount(player2Men & PLAYER2_RUNAWAY_MASK) - __builtin_popcount(player1Men & PLAYER1_RUNAWAY_MASK);
+	features[TERM_MOBILITY] = countMobility(board, PLAYER2) - countMobility(board, PLAYER1);
+}
 
-	int bestScore = -9999;
-	int bestMoveIndex = -1;
+// evaluate the board position from scratch, evaluatePosition gets the same from the running total
+int computeEvaluation(Board* board) {
+	int features[NUM_TERMS];
+	countFeatures(board, features);
 
-	int movesPerProcess = numMoves / numProcesses;
-	int remainder = numMoves % numProcesses;
+	int score = 0;
+	for (int term = 0; term < NUM_TERMS; ++term)
+		score += evaluationWeights[term] * features[term];
 
-	int startIndex = rank * movesPerProcess + (rank < remainder ? rank : remainder);
-	int endIndex = startIndex + movesPerProcess + (rank < remainder ? 1 : 0);
+	return score;
+}
 
-	// call minimax and get the index of the best move
-	#pragma omp parallel for
-	for (int i = startIndex; i < endIndex; ++i) {
-		int currentFromRow = moves[i][0];
-		int currentFromCol = moves[i][1];
-		int currentToRow = moves[i][2];
-		int currentToCol = moves[i][3];
+// evaluate the position from the point of view of PLAYER2 (the AI)
+int evaluatePosition(Board* board) {
+#ifdef SEARCH_STATS
+	SearchStats* stats = &searchStats[omp_get_thread_num() % MAX_THREADS];
+	double start = startSampledTimer(stats->evaluations++);
+#endif
+	int score = board->score;
+
+	// the only term not in the running total, skipped with its default weight of 0
+	if (evaluationWeights[TERM_MOBILITY] != 0)
+		score += evaluationWeights[TERM_MOBILITY] * (countMobility(board, PLAYER2) - countMobility(board, PLAYER1));
+
+#ifdef SEARCH_STATS
+	stopSampledTimer(start, &stats->evaluationTime);
+#endif
+	return score;
+}
 
-		int boardCopy[BOARD_SIZE][BOARD_SIZE];
-		copyBoard(board, boardCopy);
+// read a comma separated list of thread or rank counts, those outside 1 to maxCount are left out
+// returns the number of counts read
+int parseCounts(const char* list, int* counts, int maxCount) {
+	int numCounts = 0;
 
-		makeMove(boardCopy, turn, currentFromRow, currentFromCol, currentToRow, currentToCol);
-		int score = minimax(boardCopy, maxDepth, 0, PLAYER1, -9999, 9999);
+	while (*list != '\0' && numCounts < MAX_BENCHMARK_RUNS) {
+		char* end;
+		long count = strtol(list, &end, 10);
+		if (end == list) break;
 
-		#pragma omp critical
-		{
-			if (score > bestScore) {
-				bestScore = score;
-				bestMoveIndex = i;
-			}
-		}
+		if (count >= 1 && count <= maxCount)
+			counts[numCounts++] = count;
+
+		list = (*end == ',') ? end + 1 : end;
 	}
 
-	// update variables
-	*fromRow = moves[bestMoveIndex][0];
-	*fromCol = moves[bestMoveIndex][1];
-	*toRow = moves[bestMoveIndex][2];
-	*toCol = moves[bestMoveIndex][3];
-	*score = bestScore;
-}
\ No newline at end of file
+	return numCounts;
+}
+
+// the powers of two below maxCount and maxCount itself, the default sweep of the benchmark
+int sweepCounts(int maxCount, int* counts) {
+	int numCounts = 0;
+
+	for (int count = 1; count < maxCount && numCounts < MAX_BENCHMARK_RUNS - 1; count *= 2)
+		counts[numCounts++] = count;
+	counts[numCounts++] = maxCount;
+
+	return numCounts;
+}
+
+// search a position one more ply at a time like a timed move, until the depth (0 for no limit)
+// or the number of nodes (0 for no limit) is reached
+// the search starts from empty tables, so every run of a sweep does the same work
+// collective over the search communicator, the move and score are those of rank 0 and the nodes of all the ranks
+BenchmarkResult benchmarkPosition(Board* board, int turn, int maxDepth, uint64_t maxNodes, int rank, int numProcesses) {
+	BenchmarkResult result;
+	memset(&result, 0, sizeof(result));
+
+	memset(transpositionTable, 0, (transpositionMask + 1) * sizeof(TTEntry));
+	resetOrderingTables();
+	resetNodeCounts();
+
+	// each rank has an even share of the node limit
+	searchNodeLimit = (maxNodes + numProcesses - 1) / numProcesses;
+	searchNodes = 0;
+	searchAborted = 0;
+
+	MPI_Barrier(searchCommunicator);
+	double start = omp_get_wtime();
+
+	// a depth cut short by the node limit keeps the move of the one before, its nodes still count
+	while (result.depth < MAX_SEARCH_DEPTH && (maxDepth == 0 || result.depth < maxDepth)) {
+		int completed = getBestMoveForOpponent(board, turn, result.depth, &result.move[0], &result.move[1], &result.move[2], &result.move[3], &result.score, rank, numProcesses);
+
+		// every rank stops at the same depth
+		int allCompleted;
+		MPI_Allreduce(&completed, &allCompleted, 1, MPI_INT, MPI_MIN, searchCommunicator);
+		if (!allCompleted) break;
+
+		result.depthSeconds[result.depth++] = omp_get_wtime() - start;
+	}
+
+	result.seconds = omp_get_wtime() - start;
+	uint64_t nodes = sumNodeCounts();
+	MPI_Allreduce(&nodes, &result.nodes, 1, MPI_UINT64_T, MPI_SUM, searchCommunicator);
+
+	searchNodeLimit = 0;
+	searchAborted = 0;
+
+	return result;
+}
+
+// print the header of a benchmark run, as text or as the start of a JSON object
+void printBenchmarkRunStart(int ranks, int threads, int json, int first) {
+	if (json)
+		printf("%s  {\"ranks\": %d, \"threads\": %d, \"positions\": [\n", first ? "" : ",\n", ranks, threads);
+	else if (ranks > 1)
+		printf("%d ranks with %d thread%s each\n", ranks, threads, threads == 1 ? "" : "s");
+	else
+		printf("%d thread%s\n", threads, threads == 1 ? "" : "s");
+}
+
+// print the result of a benchmark position, with the time to reach each depth
+void printBenchmarkPosition(const char* name, BenchmarkResult* result, int json, int first) {
+	double nodesPerSecond = result->seconds > 0 ? result->nodes / result->seconds : 0.0;
+
+	if (json) {
+		printf("%s    {\"name\": \"%s\", \"depth\": %d, \"score\": %d, \"move\": [%d, %d, %d, %d], ", first ? "" : ",\n",
+			name, result->depth, result->score, result->move[0], result->move[1], result->move[2], result->move[3]);
+		printf("\"nodes\": %llu, \"seconds\": %.6f, \"nodesPerSecond\": %.0f, \"timeToDepth\": [",
+			(unsigned long long)result->nodes, result->seconds, nodesPerSecond);
+		for (int depth = 0; depth < result->depth; ++depth)
+			printf("%s%.6f", depth ? ", " : "", result->depthSeconds[depth]);
+		printf("]}");
+	} else {
+		printf("  %-14s %2d plies, score %d, move %d %d %d %d, %llu nodes in %.3f s, %.2f million nodes/s\n",
+			name, result->depth, result->score, result->move[0], result->move[1], result->move[2], result->move[3],
+			(unsigned long long)result->nodes, result->seconds, nodesPerSecond / 1e6);
+		printf("  %-14s time to depth:", "");
+		for (int depth = 0; depth < result->depth; ++depth)
+			printf(" %.3f", result->depthSeconds[depth]);
+		printf("\n");
+	}
+}
+
+// print the totals of a benchmark run, the speedup and efficiency are against the first run of the sweep
+void printBenchmarkRunEnd(uint64_t nodes, double seconds, double speedup, double efficiency, int json) {
+	double nodesPerSecond = seconds > 0 ? nodes / seconds : 0.0;
+
+	if (json)
+		printf("\n  ], \"nodes\": %llu, \"seconds\": %.6f, \"nodesPerSecond\": %.0f, \"speedup\": %.3f, \"efficiency\": %.3f}",
+			(unsigned long long)nodes, seconds, nodesPerSecond, speedup, efficiency);
+	else
+		printf("  total: %llu nodes in %.3f s, %.2f million nodes/s, speedup %.2f, efficiency %.1f%%\n",
+			(unsigned long long)nodes, seconds, nodesPerSecond / 1e6, speedup, 100.0 * efficiency);
+}
+
+// search the benchmark positions with each number of ranks and report the speed and how it scales
+// each run gets a communicator with its first ranks and a distributed table over them, the other ranks wait
+void runBenchmark(int maxDepth, uint64_t maxNodes, int* rankCounts, int numRankCounts, int json, size_t distributedHashMegabytes) {
+	int worldRank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+	double baseSeconds = 0;
+
+	if (worldRank == 0 && json) printf("{\"runs\": [\n");
+
+	for (int run = 0; run < numRankCounts; ++run) {
+		int ranks = rankCounts[run];
+		MPI_Comm_split(MPI_COMM_WORLD, worldRank < ranks ? 0 : MPI_UNDEFINED, worldRank, &searchCommunicator);
+
+		if (searchCommunicator != MPI_COMM_NULL) {
+			if (worldRank == 0)
+				printBenchmarkRunStart(ranks, omp_get_max_threads(), json, run == 0);
+
+			uint64_t nodes = 0;
+			double seconds = 0;
+
+			for (int i = 0; i < NUM_BENCHMARK_POSITIONS; ++i) {
+				Board board;
+				int turn;
+				parsePosition(benchmarkPositions[i][1], "2", &board, &turn);
+
+				// an empty distributed table for each position too
+				initializeDistributedTable(distributedHashMegabytes, ranks);
+				BenchmarkResult result = benchmarkPosition(&board, turn, maxDepth, maxNodes, worldRank, ranks);
+				freeDistributedTable();
+
+				nodes += result.nodes;
+				seconds += result.seconds;
+				if (worldRank == 0) {
+					printBenchmarkPosition(benchmarkPositions[i][0], &result, json, i == 0);
+					fflush(stdout);
+				}
+			}
+
+			if (run == 0) baseSeconds = seconds;
+			double speedup = seconds > 0 ? baseSeconds / seconds : 0.0;
+			if (worldRank == 0)
+				printBenchmarkRunEnd(nodes, seconds, speedup, speedup * rankCounts[0] / ranks, json);
+
+			MPI_Comm_free(&searchCommunicator);
+		}
+
+		MPI_Barrier(MPI_COMM_WORLD);
+	}
+
+	searchCommunicator = MPI_COMM_WORLD;
+
+	if (worldRank == 0 && json) printf("\n]}\n");
+}
+
+// search a position to a fixed depth on the calling thread alone, one more ply at a time, for either player
+// returns the score, like every score the higher the better for player 2, and the best move, 0 if there is none
+int analyzePosition(Board* board, int turn, int depth, Move* bestMove) {
+	int maximizing = (turn == PLAYER2);
+	int nextTurn = maximizing ? PLAYER1 : PLAYER2;
+	int numMoves = 0;
+	Move* moves = getPossibleMoves(board, turn, &numMoves);
+
+	// a player without moves has lost
+	int bestScore = maximizing ? -9999 : 9999;
+	*bestMove = 0;
+
+	for (int maxDepth = 0; maxDepth < depth && numMoves > 0; ++maxDepth) {
+		// the best move of the previous iteration is searched first
+		int ttScore, ttMove;
+		probeTransposition(board->hash, MAX_SEARCH_DEPTH, -9999, 9999, &ttScore, &ttMove);
+		orderMoves(board, turn, moves, numMoves, ttMove, 0);
+
+		int alpha = -9999, beta = 9999;
+		int bestIndex = 0;
+
+		for (int i = 0; i < numMoves; ++i) {
+			MoveUndo undo = makeMove(board, turn, moves[i]);
+			int score = minimax(board, maxDepth, 0, nextTurn, alpha, beta);
+			unmakeMove(board, undo);
+
+			if (i == 0 || (maximizing ? score > bestScore : score < bestScore)) {
+				bestScore = score;
+				bestIndex = i;
+			}
+
+			if (maximizing && bestScore > alpha) alpha = bestScore;
+			if (!maximizing && bestScore < beta) beta = bestScore;
+		}
+
+		storeTransposition(board->hash, maxDepth + 1, bestScore, TT_EXACT, moves[bestIndex] & MOVE_KEY_MASK);
+		*bestMove = moves[bestIndex];
+	}
+
+	releaseMoves(numMoves);
+
+	return bestScore;
+}
+
+// read up to maxLines lines that are not blank, without the line ends
+// returns the number of lines read, 0 at the end of the input
+int readLines(FILE* input, char lines[][BATCH_LINE_LENGTH], int maxLines) {
+	int count = 0;
+
+	while (count < maxLines && fgets(lines[count], BATCH_LINE_LENGTH, input) != NULL) {
+		char* line = lines[count];
+		size_t length = strcspn(line, "\r\n");
+
+		// the rest of a line too long to be a position
+		if (line[length] == '\0' && length == BATCH_LINE_LENGTH - 1) {
+			int c;
+			while ((c = fgetc(input)) != '\n' && c != EOF);
+		}
+
+		line[length] = '\0';
+		if (length > 0)
+			count++;
+	}
+
+	return count;
+}
+
+// analyze the lines first, first + step, ... as positions, each one by a single thread of the team
+// more positions than threads at a time keep the threads busy while the longer searches end
+void analyzeLines(char lines[][BATCH_LINE_LENGTH], int count, int first, int step, int depth, AnalysisResult* results) {
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = first; i < count; i += step) {
+		AnalysisResult* result = &results[i];
+		char squares[BATCH_LINE_LENGTH], player[BATCH_LINE_LENGTH];
+		Board board;
+		int turn;
+
+		if (sscanf(lines[i], "%63s %63s", squares, player) != 2 || !parsePosition(squares, player, &board, &turn)) {
+			result->move = -1;
+			continue;
+		}
+
+		uint64_t* nodes = &nodeCounts[omp_get_thread_num() % MAX_THREADS].nodes;
+		uint64_t nodesBefore = *nodes;
+		Move move;
+
+		result->score = analyzePosition(&board, turn, depth, &move);
+		result->move = move;
+		result->depth = move ? depth : 0;
+		result->nodes = *nodes - nodesBefore;
+	}
+}
+
+// print each line with the best move, the score, the depth and the nodes searched, in the order of the input
+void printAnalysis(char lines[][BATCH_LINE_LENGTH], int count, AnalysisResult* results) {
+	for (int i = 0; i < count; ++i) {
+		AnalysisResult* result = &results[i];
+
+		if (result->move < 0) {
+			printf("%s invalid\n", lines[i]);
+		} else if (result->move == 0) {
+			printf("%s - - - - %lld 0 0\n", lines[i], (long long)result->score);
+		} else {
+			int from = (result->move >> 5) & 31, to = result->move & 31;
+			printf("%s %d %d %d %d %lld %lld %llu\n", lines[i], squareRow(from), squareCol(from), squareRow(to), squareCol(to),
+				(long long)result->score, (long long)result->depth, (unsigned long long)result->nodes);
+		}
+	}
+
+	fflush(stdout);
+}
+
+// analyze the positions of a file, or of the standard input for "-", one line each as with -position
+// rank 0 reads them a batch at a time and sends the batch to every rank, each rank analyzes every
+// numProcesses-th position with its threads and rank 0 adds up the results and prints them
+// returns 0 if the file could not be read
+int runAnalysis(const char* path, int depth, int rank, int numProcesses) {
+	FILE* input = NULL;
+	int opened = 1;
+	if (rank == 0) {
+		input = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+		if (input == NULL) {
+			fprintf(stderr, "Could not read the positions from %s\n", path);
+			opened = 0;
+		}
+	}
+
+	// the batch is sized for the threads of all the ranks, every rank gets the same size
+	int threads = omp_get_max_threads(), totalThreads;
+	MPI_Allreduce(&threads, &totalThreads, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+	int maxLines = BATCH_POSITIONS_PER_THREAD * totalThreads;
+	char (*lines)[BATCH_LINE_LENGTH] = malloc(maxLines * sizeof(*lines));
+	AnalysisResult* results = malloc(maxLines * sizeof(AnalysisResult));
+	if (lines == NULL || results == NULL) {
+		fprintf(stderr, "Could not allocate %d positions\n", maxLines);
+		exit(1);
+	}
+
+	while (1) {
+		int count = (rank == 0 && opened) ? readLines(input, lines, maxLines) : 0;
+		MPI_Bcast(&count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+		if (count == 0) break;
+
+		MPI_Bcast(lines, count * BATCH_LINE_LENGTH, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+		// the results of the positions of other ranks stay at zero
+		memset(results, 0, count * sizeof(AnalysisResult));
+		analyzeLines(lines, count, rank, numProcesses, depth, results);
+
+		MPI_Reduce(rank == 0 ? MPI_IN_PLACE : results, results, count * 4, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+		if (rank == 0)
+			printAnalysis(lines, count, results);
+	}
+
+	if (input != NULL && input != stdin)
+		fclose(input);
+	free(lines);
+	free(results);
+
+	return opened;
+}
+
+// binomial coefficients and where the values of each number of pieces start
+void initializeTablebaseIndex() {
+	for (int n = 0; n <= NUM_SQUARES; ++n) {
+		binomial[n][0] = 1;
+		for (int k = 1; k <= TB_MAX_PIECES; ++k)
+			binomial[n][k] = (n == 0) ? 0 : binomial[n - 1][k - 1] + binomial[n - 1][k];
+	}
+
+	// each set of occupied squares, with 4 kinds of piece on each square and 2 players to move
+	tablebaseOffsets[0] = 0;
+	tablebaseOffsets[1] = 0;
+	for (int pieces = 1; pieces <= TB_MAX_PIECES; ++pieces)
+		tablebaseOffsets[pieces + 1] = tablebaseOffsets[pieces] + binomial[NUM_SQUARES][pieces] * (1ull << (2 * pieces)) * 2;
+}
+
+// index of a position in the tablebase, the occupied squares are ranked in the combinatorial
+// number system and the pieces on them (in square order) and the player to move are the low digits
+uint64_t tablebaseIndex(Board* board, int turn) {
+	uint32_t occupied = board->pieces[0] | board->pieces[1];
+	int pieces = __builtin_popcount(occupied);
+	uint64_t squares = 0, kinds = 0;
+
+	int i = 0;
+	for (uint32_t bits = occupied; bits; bits &= bits - 1, ++i) {
+		int square = __builtin_ctz(bits);
+		squares += binomial[square][i + 1];
+		kinds |= (uint64_t)(getSquare(board, square) - 1) << (2 * i);
+	}
+
+	return tablebaseOffsets[pieces] + ((squares << (2 * pieces)) + kinds) * 2 + (turn - 1);
+}
+
+// map a tablebase file, the pages are read by the system as the search probes them
+void loadTablebase(const char* path) {
+	int fd = open(path, O_RDONLY);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0) {
+		fprintf(stderr, "Could not open the tablebase file %s\n", path);
+		exit(1);
+	}
+
+	void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		fprintf(stderr, "Could not map the tablebase file %s\n", path);
+		exit(1);
+	}
+
+	initializeTablebaseIndex();
+
+	TablebaseHeader* header = mapped;
+	if ((size_t)info.st_size < sizeof(TablebaseHeader) || strcmp(header->magic, "CKRTB1") != 0 ||
+		header->pieces < 1 || header->pieces > TB_MAX_PIECES ||
+		(size_t)info.st_size != sizeof(TablebaseHeader) + tablebaseOffsets[header->pieces + 1]) {
+		fprintf(stderr, "%s is not a tablebase file\n", path);
+		exit(1);
+	}
+
+	tablebase = (uint8_t*)mapped + sizeof(TablebaseHeader);
+	tablebasePieces = header->pieces;
+	tablebaseFileSize = info.st_size;
+}
+
+// look the position up in the tablebase when it has few enough pieces
+// the score is from the point of view of PLAYER2, as evaluatePosition
+// returns 0 if the position is not in the tablebase
+int probeTablebase(Board* board, int turn, int* score) {
+	if (__builtin_popcount(board->pieces[0] | board->pieces[1]) > tablebasePieces) return 0;
+
+	int value = tablebase[tablebaseIndex(board, turn)];
+
+	// shorter wins and longer losses are better
+	if (value >= TB_WIN)
+		*score = TB_SCORE - (value - TB_WIN);
+	else if (value >= TB_LOSS)
+		*score = -TB_SCORE + (value - TB_LOSS);
+	else
+		*score = 0;
+
+	if (turn == PLAYER1)
+		*score = -*score;
+
+	return 1;
+}
+
+// map an opening book file
+void loadBook(const char* path) {
+	int fd = open(path, O_RDONLY);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0) {
+		fprintf(stderr, "Could not open the book file %s\n", path);
+		exit(1);
+	}
+
+	void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		fprintf(stderr, "Could not map the book file %s\n", path);
+		exit(1);
+	}
+
+	BookHeader* header = mapped;
+	if ((size_t)info.st_size < sizeof(BookHeader) || strcmp(header->magic, "CKRBK1") != 0 ||
+		(size_t)info.st_size != sizeof(BookHeader) + header->entries * sizeof(BookEntry)) {
+		fprintf(stderr, "%s is not a book file\n", path);
+		exit(1);
+	}
+
+	openingBook = (BookEntry*)((char*)mapped + sizeof(BookHeader));
+	openingBookEntries = header->entries;
+}
+
+// binary search the opening book for the position
+// returns 0 if it is not in the book, or if the book move is not legal here (another position with the same hash)
+int probeBook(Board* board, int turn, int move[4], int* score) {
+	if (openingBook == NULL || turn != PLAYER2) return 0;
+
+	uint64_t low = 0, high = openingBookEntries;
+	while (low < high) {
+		uint64_t middle = low + (high - low) / 2;
+		if (openingBook[middle].hash < board->hash)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if (low == openingBookEntries || openingBook[low].hash != board->hash) return 0;
+
+	keyToMove(openingBook[low].move, move);
+	if (!isValidMove(board, turn, move[0], move[1], move[2], move[3])) return 0;
+
+	*score = openingBook[low].score;
+	return 1;
+}
+
+// pack a move as (from square << 5) | to square, the form stored in the transposition table
+// and the move ordering tables, 0 is never a move
+int moveToKey(int move[4]) {
+	return (squareIndex(move[0], move[1]) << 5) | squareIndex(move[2], move[3]);
+}
+
+// back from the key to (fromRow, fromCol, toRow, toCol)
+void keyToMove(int key, int move[4]) {
+	move[0] = squareRow(key >> 5);
+	move[1] = squareCol(key >> 5);
+	move[2] = squareRow(key & 31);
+	move[3] = squareCol(key & 31);
+}
+
+// sort the moves so the ones most likely to cause a cutoff are searched first:
+// the transposition table move, captures by the value of the captured piece, promotions,
+// the killer moves of this ply and then the rest by their history score
+void orderMoves(Board* board, int turn, Move* moves, int numMoves, int ttMove, int depth) {
+	// a player without moves, nothing to sort (and no zero length array for the keys)
+	if (numMoves <= 0) return;
+
+	OrderingTables* tables = &orderingTables[omp_get_thread_num() % MAX_THREADS];
+	int keys[numMoves];
+
+	for (int i = 0; i < numMoves; ++i) {
+		int key = moves[i] & MOVE_KEY_MASK;
+		int from = key >> 5, to = key & 31;
+
+		if (key == ttMove) {
+			keys[i] = 4000000;
+		} else if (moves[i] & MOVE_CAPTURE) {
+			int captured = getSquare(board, moves[i] >> MOVE_CAPTURED_SHIFT);
+
+			// taking your own piece is legal here but never a good first try
+			if (captured == turn || captured == turn + 2)
+				keys[i] = -1;
+			else
+				keys[i] = 3000000 + (captured > PLAYER2 ? 300 : 100);
+		} else if (moves[i] & MOVE_PROMOTION) {
+			keys[i] = 2500000;
+		} else if (key == tables->killers[depth][0]) {
+			keys[i] = 2000001;
+		} else if (key == tables->killers[depth][1]) {
+			keys[i] = 2000000;
+		} else {
+			keys[i] = tables->history[turn - 1][from][to];
+		}
+	}
+
+	// insertion sort, stable so ties keep the generation order
+	for (int i = 1; i < numMoves; ++i) {
+		int key = keys[i];
+		Move move = moves[i];
+		int j = i - 1;
+
+		while (j >= 0 && keys[j] < key) {
+			keys[j + 1] = keys[j];
+			moves[j + 1] = moves[j];
+			j--;
+		}
+
+		keys[j + 1] = key;
+		moves[j + 1] = move;
+	}
+}
+
+// count a cutoff in the counters of the thread, by the index of the move that caused it
+void countCutoff(int moveIndex) {
+	int thread = omp_get_thread_num() % MAX_THREADS;
+	OrderingTables* tables = &orderingTables[thread];
+
+#ifdef SEARCH_STATS
+	searchStats[thread].cutoffs[moveIndex < CUTOFF_INDEX_BUCKETS ? moveIndex : CUTOFF_INDEX_BUCKETS - 1]++;
+#endif
+
+	tables->cutoffs++;
+	if (moveIndex == 0)
+		tables->firstMoveCutoffs++;
+}
+
+// update the killers and history of the thread after a move caused a cutoff
+void recordCutoff(int turn, Move move, int depth, int remainingDepth, int moveIndex) {
+	OrderingTables* tables = &orderingTables[omp_get_thread_num() % MAX_THREADS];
+
+	countCutoff(moveIndex);
+
+	// captures and promotions are already tried early
+	if (move & (MOVE_CAPTURE | MOVE_PROMOTION)) return;
+
+	int key = move & MOVE_KEY_MASK;
+	if (tables->killers[depth][0] != key) {
+		tables->killers[depth][1] = tables->killers[depth][0];
+		tables->killers[depth][0] = key;
+	}
+
+	// deeper cutoffs say more about a move, keep the history below the killer keys
+	int* history = &tables->history[turn - 1][key >> 5][key & 31];
+	*history += remainingDepth * remainingDepth;
+	if (*history > 1000000)
+		*history = 1000000;
+}
+
+// clear the move ordering tables and counters of all threads
+void resetOrderingTables() {
+	memset(orderingTables, 0, sizeof(orderingTables));
+}
+
+// sum the cutoff counters of all threads, as { cutoffs, first move cutoffs }
+void sumOrderingStats(uint64_t stats[2]) {
+	stats[0] = 0;
+	stats[1] = 0;
+
+	for (int i = 0; i < MAX_THREADS; ++i) {
+		stats[0] += orderingTables[i].cutoffs;
+		stats[1] += orderingTables[i].firstMoveCutoffs;
+	}
+}
+
+// print how often the first move searched was already good enough for a cutoff
+void printOrderingStats(uint64_t stats[2]) {
+	printf("Move ordering: %llu cutoffs, %.1f%% on the first move\n",
+		(unsigned long long)stats[0], stats[0] ? 100.0 * stats[1] / stats[0] : 0.0);
+}
+
+// check if a timed search ran out of time
+int isSearchAborted() {
+	return __atomic_load_n(&searchAborted, __ATOMIC_RELAXED);
+}
+
+// count a node of the search and check if it ran out of time or nodes, looking every 1024 nodes
+// rank 0 answers the workers as often, from thread 0 as the others may not use MPI
+int visitNode() {
+	uint64_t nodes = ++nodeCounts[omp_get_thread_num() % MAX_THREADS].nodes;
+	if ((nodes & 1023) == 0) {
+		if (searchDeadline > 0 && omp_get_wtime() > searchDeadline)
+			__atomic_store_n(&searchAborted, 1, __ATOMIC_RELAXED);
+		if (searchNodeLimit > 0 && __atomic_add_fetch(&searchNodes, 1024, __ATOMIC_RELAXED) >= searchNodeLimit)
+			__atomic_store_n(&searchAborted, 1, __ATOMIC_RELAXED);
+
+		if (omp_get_thread_num() == 0 && rootQueue.busyWorkers > 0)
+			serveWorkers();
+	}
+
+	return isSearchAborted();
+}
+
+// clear the node counters
+void resetNodeCounts() {
+	memset(nodeCounts, 0, sizeof(nodeCounts));
+}
+
+// sum the nodes searched by all threads
+uint64_t sumNodeCounts() {
+	uint64_t total = 0;
+
+	for (int i = 0; i < MAX_THREADS; ++i)
+		total += nodeCounts[i].nodes;
+
+	return total;
+}
+
+#ifdef SEARCH_STATS
+// start timing a call if it is one of those sampled, returns 0 if it is not
+double startSampledTimer(uint64_t calls) {
+	return (calls % STATS_SAMPLE_RATE == 0) ? omp_get_wtime() : 0;
+}
+
+// add the time of a sampled call, standing for the calls not timed
+void stopSampledTimer(double start, uint64_t* total) {
+	if (start == 0) return;
+
+	double elapsed = omp_get_wtime() - start - clockOverhead;
+	if (elapsed > 0)
+		*total += elapsed * 1e9 * STATS_SAMPLE_RATE;
+}
+
+// clear the search counters and the node counters of all threads,
+// and measure how long reading the clock takes to leave it out of the times
+void resetSearchStats() {
+	memset(searchStats, 0, sizeof(searchStats));
+	resetNodeCounts();
+
+	double start = omp_get_wtime(), end = start;
+	for (int i = 0; i < 1000; ++i)
+		end = omp_get_wtime();
+	clockOverhead = (end - start) / 1000;
+}
+
+// sum the search counters of all threads, the nodes past the horizon are the nodes not counted by depth
+SearchStats sumSearchStats() {
+	SearchStats total;
+	memset(&total, 0, sizeof(total));
+
+	for (int i = 0; i < MAX_THREADS; ++i) {
+		SearchStats* stats = &searchStats[i];
+
+		for (int depth = 0; depth < MAX_SEARCH_DEPTH; ++depth)
+			total.nodes[depth] += stats->nodes[depth];
+		for (int index = 0; index < CUTOFF_INDEX_BUCKETS; ++index)
+			total.cutoffs[index] += stats->cutoffs[index];
+		total.evaluations += stats->evaluations;
+		total.generations += stats->generations;
+		total.movesGenerated += stats->movesGenerated;
+		total.captureGenerations += stats->captureGenerations;
+		total.generationTime += stats->generationTime;
+		total.evaluationTime += stats->evaluationTime;
+	}
+
+	total.quiescenceNodes = sumNodeCounts();
+	for (int depth = 0; depth < MAX_SEARCH_DEPTH; ++depth)
+		total.quiescenceNodes -= total.nodes[depth];
+
+	return total;
+}
+
+// print the search counters, the times are summed over the threads
+void printSearchStats(SearchStats* total) {
+	uint64_t nodes = total->quiescenceNodes, cutoffs = 0;
+	int maxDepth = 0;
+	for (int depth = 0; depth < MAX_SEARCH_DEPTH; ++depth) {
+		nodes += total->nodes[depth];
+		if (total->nodes[depth] > 0) maxDepth = depth + 1;
+	}
+	for (int index = 0; index < CUTOFF_INDEX_BUCKETS; ++index)
+		cutoffs += total->cutoffs[index];
+
+	printf("Search: %llu nodes, %llu past the horizon, %llu evaluations, branching factor %.2f\n",
+		(unsigned long long)nodes, (unsigned long long)total->quiescenceNodes, (unsigned long long)total->evaluations,
+		total->generations ? (double)total->movesGenerated / total->generations : 0.0);
+
+	printf("Nodes by depth:");
+	for (int depth = 0; depth < maxDepth; ++depth)
+		printf(" %llu", (unsigned long long)total->nodes[depth]);
+	printf("\n");
+
+	printf("Beta cutoffs by index of the move that cut:");
+	for (int index = 0; index < CUTOFF_INDEX_BUCKETS; ++index)
+		printf(" %d%s %.1f%%", index, index == CUTOFF_INDEX_BUCKETS - 1 ? "+" : "", cutoffs ? 100.0 * total->cutoffs[index] / cutoffs : 0.0);
+	printf("\n");
+
+	printf("Time in move generation %.3f s, in evaluation %.3f s\n", total->generationTime / 1e9, total->evaluationTime / 1e9);
+}
+#endif
+
+#ifdef PERF_COUNTERS
+// open the counters of every thread of the team, each thread opens its own
+// the team keeps the same threads as long as its size doesn't change
+// returns the number of counters opened, 0 if the kernel or the processor allows none
+int openPerfCounters() {
+	uint64_t events[NUM_PERF_EVENTS][2] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	};
+
+	int threads = omp_get_max_threads() < MAX_THREADS ? omp_get_max_threads() : MAX_THREADS;
+	int opened = 0;
+
+	#pragma omp parallel num_threads(threads) reduction(+:opened)
+	{
+		int thread = omp_get_thread_num();
+
+		for (int event = 0; event < NUM_PERF_EVENTS; ++event) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = events[event][0];
+			attr.config = events[event][1];
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			// user space only, allowed with the default perf_event_paranoid of 2
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+
+			perfEventFiles[thread][event] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+			if (perfEventFiles[thread][event] >= 0)
+				opened++;
+		}
+	}
+
+	perfThreads = threads;
+	if (opened == 0)
+		closePerfCounters();
+
+	return opened;
+}
+
+// close the counters of all threads
+void closePerfCounters() {
+	for (int thread = 0; thread < perfThreads; ++thread) {
+		for (int event = 0; event < NUM_PERF_EVENTS; ++event) {
+			if (perfEventFiles[thread][event] >= 0)
+				close(perfEventFiles[thread][event]);
+		}
+	}
+
+	perfThreads = 0;
+}
+
+// sum the counters of all threads, scaled up for the time an event had to share the hardware with others
+// returns a mask of the events counted by every thread
+int readPerfCounters(uint64_t counts[NUM_PERF_EVENTS]) {
+	int available = perfThreads > 0 ? (1 << NUM_PERF_EVENTS) - 1 : 0;
+
+	for (int event = 0; event < NUM_PERF_EVENTS; ++event) {
+		counts[event] = 0;
+
+		for (int thread = 0; thread < perfThreads; ++thread) {
+			uint64_t values[3]; // the count, the time enabled and the time running
+			int file = perfEventFiles[thread][event];
+
+			if (file < 0 || read(file, values, sizeof(values)) != sizeof(values)) {
+				available &= ~(1 << event);
+				continue;
+			}
+
+			if (values[2] > 0)
+				counts[event] += (uint64_t)((double)values[0] * values[1] / values[2]);
+		}
+	}
+
+	return available;
+}
+
+// turn the counts read before a search into the counts of the search
+// returns a mask of the events counted by every thread
+int stopPerfCounters(uint64_t counts[NUM_PERF_EVENTS]) {
+	uint64_t now[NUM_PERF_EVENTS];
+	int available = readPerfCounters(now);
+
+	for (int event = 0; event < NUM_PERF_EVENTS; ++event)
+		counts[event] = now[event] - counts[event];
+
+	return available;
+}
+
+// print the counts of a search per node searched, and the instructions per cycle
+void printPerfCounters(uint64_t counts[NUM_PERF_EVENTS], int available, uint64_t nodes) {
+	printf("Hardware counters per node:");
+	for (int event = 0; event < NUM_PERF_EVENTS; ++event) {
+		if (!(available & (1 << event)))
+			printf(" n/a %s%s", perfEventNames[event], event < NUM_PERF_EVENTS - 1 ? "," : "");
+		else
+			printf(" %.1f %s%s", nodes ? (double)counts[event] / nodes : 0.0, perfEventNames[event], event < NUM_PERF_EVENTS - 1 ? "," : "");
+	}
+
+	// cycles and instructions are the first two events
+	if ((available & 3) == 3 && counts[0] > 0)
+		printf(", %.2f instructions per cycle", (double)counts[1] / counts[0]);
+	printf("\n");
+}
+#endif
+
+// allocate the trace buffers of the threads of a team this large and start recording
+// the buffers are written once here, so the pages are in memory before the search records to them
+void initializeTrace(int threads) {
+	for (int thread = 0; thread < threads && thread < MAX_THREADS; ++thread) {
+		TraceBuffer* buffer = &traceBuffers[thread];
+		buffer->events = calloc(TRACE_EVENTS_PER_THREAD, sizeof(TraceEvent));
+		if (buffer->events == NULL) {
+			fprintf(stderr, "Could not allocate the trace buffers\n");
+			exit(1);
+		}
+
+		memset(buffer->events, 0, TRACE_EVENTS_PER_THREAD * sizeof(TraceEvent));
+		buffer->capacity = TRACE_EVENTS_PER_THREAD;
+	}
+
+	traceStart = omp_get_wtime();
+	tracing = 1;
+}
+
+// start of a span, 0 when not tracing
+double traceBegin() {
+	return tracing ? omp_get_wtime() : 0;
+}
+
+// record a span from start until now in the buffer of the thread, dropped if the buffer is full
+void traceEnd(int kind, double start, int arg) {
+	if (!tracing) return;
+
+	double end = omp_get_wtime();
+	int thread = omp_get_thread_num() % MAX_THREADS;
+	TraceBuffer* buffer = &traceBuffers[thread];
+
+	if (buffer->count == buffer->capacity) {
+		buffer->dropped++;
+		return;
+	}
+
+	TraceEvent* event = &buffer->events[buffer->count++];
+	event->kind = kind;
+	event->thread = thread;
+	event->arg = arg;
+	event->start = start - traceStart;
+	event->end = end - traceStart;
+}
+
+// a move as the digits of its rows and columns, 2132 for 2 1 3 2, to read it in the trace
+int moveDigits(Move move) {
+	int from = (move >> 5) & 31, to = move & 31;
+
+	return squareRow(from) * 1000 + squareCol(from) * 100 + squareRow(to) * 10 + squareCol(to);
+}
+
+// write spans as complete events of a Chrome trace, times in microseconds
+void writeTraceEvents(FILE* file, TraceEvent* events, int count, int process, int* first) {
+	for (int i = 0; i < count; ++i) {
+		TraceEvent* event = &events[i];
+
+		fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+			*first ? "" : ",\n", traceNames[event->kind], process, event->thread, event->start * 1e6, (event->end - event->start) * 1e6);
+		if (traceArgNames[event->kind] != NULL)
+			fprintf(file, ", \"args\": {\"%s\": %d}", traceArgNames[event->kind], event->arg);
+		fprintf(file, "}");
+
+		*first = 0;
+	}
+}
+
+// write the spans of all threads of all ranks as a Chrome trace, to open in chrome://tracing or Perfetto
+// collective over all the ranks, rank 0 gathers the spans and writes them with the rank as the process
+void writeTrace(const char* path, int rank, int numProcesses) {
+	int count = 0;
+	uint64_t dropped = 0;
+	for (int thread = 0; thread < MAX_THREADS; ++thread) {
+		count += traceBuffers[thread].count;
+		dropped += traceBuffers[thread].dropped;
+	}
+
+	TraceEvent* events = malloc((count > 0 ? count : 1) * sizeof(TraceEvent));
+	if (events == NULL) {
+		fprintf(stderr, "Could not allocate %d spans\n", count);
+		exit(1);
+	}
+
+	int packed = 0;
+	for (int thread = 0; thread < MAX_THREADS; ++thread) {
+		memcpy(&events[packed], traceBuffers[thread].events, traceBuffers[thread].count * sizeof(TraceEvent));
+		packed += traceBuffers[thread].count;
+	}
+
+	// the spans are sent as bytes, every rank runs the same program
+	int bytes = count * sizeof(TraceEvent);
+	int rankBytes[numProcesses], offsets[numProcesses];
+	MPI_Gather(&bytes, 1, MPI_INT, rankBytes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+	TraceEvent* allEvents = NULL;
+	if (rank == 0) {
+		int total = 0;
+		for (int i = 0; i < numProcesses; ++i) {
+			offsets[i] = total;
+			total += rankBytes[i];
+		}
+
+		allEvents = malloc(total > 0 ? total : 1);
+		if (allEvents == NULL) {
+			fprintf(stderr, "Could not allocate %d bytes of spans\n", total);
+			exit(1);
+		}
+	}
+
+	MPI_Gatherv(events, bytes, MPI_BYTE, allEvents, rankBytes, offsets, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+	uint64_t allDropped;
+	MPI_Reduce(&dropped, &allDropped, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+	if (rank == 0) {
+		FILE* file = fopen(path, "w");
+		if (file == NULL) {
+			fprintf(stderr, "Could not write the trace to %s\n", path);
+		} else {
+			int first = 1;
+
+			fprintf(file, "{\"traceEvents\": [\n");
+			for (int i = 0; i < numProcesses; ++i)
+				writeTraceEvents(file, (TraceEvent*)((char*)allEvents + offsets[i]), rankBytes[i] / sizeof(TraceEvent), i, &first);
+			fprintf(file, "\n]}\n");
+			fclose(file);
+		}
+
+		if (allDropped > 0)
+			fprintf(stderr, "%llu spans did not fit in the trace buffers\n", (unsigned long long)allDropped);
+	}
+
+	free(events);
+	free(allEvents);
+}
+
+// search captures and promotions past the horizon, so a position is not evaluated in the middle of an exchange
+// the side to move may also stand pat, keep the static evaluation instead of making any of those moves
+int quiescence(Board* board, int ply, int turn, int alpha, int beta) {
+	int tablebaseScore;
+	if (probeTablebase(board, turn, &tablebaseScore)) return tablebaseScore;
+
+	int standPat = evaluatePosition(board);
+	if (visitNode() || ply == MAX_QUIESCENCE_DEPTH) return standPat;
+
+	if (turn == PLAYER2) {
+		if (standPat >= beta) return standPat;
+		if (standPat > alpha) alpha = standPat;
+	} else {
+		if (standPat <= alpha) return standPat;
+		if (standPat < beta) beta = standPat;
+	}
+
+	int numMoves = 0;
+	Move* moves = getCaptureMoves(board, turn, &numMoves);
+
+	int bestScore = standPat;
+
+	for (int i = 0; i < numMoves; i++) {
+		MoveUndo undo = makeMove(board, turn, moves[i]);
+		int score = quiescence(board, ply + 1, (turn == PLAYER1) ? PLAYER2 : PLAYER1, alpha, beta);
+		unmakeMove(board, undo);
+
+		if (turn == PLAYER2) {
+			if (score > bestScore) bestScore = score;
+			if (bestScore > alpha) alpha = bestScore;
+		} else {
+			if (score < bestScore) bestScore = score;
+			if (bestScore < beta) beta = bestScore;
+		}
+
+		// only captures and promotions are searched here, they don't go to the killers or the history
+		if (beta <= alpha) {
+			countCutoff(i);
+			break;
+		}
+	}
+
+	releaseMoves(numMoves);
+
+	return bestScore;
+}
+
+// minimax with alpha-beta prunning
+// when the search is aborted the returned score is meaningless and must be thrown away
+int minimax(Board* board, int maxDepth, int depth, int turn, int alpha, int beta) {
+	// with few pieces left the result is known
+	int tablebaseScore;
+	if (probeTablebase(board, turn, &tablebaseScore)) return tablebaseScore;
+
+	// when max depth is reached, only captures and promotions are searched before evaluating
+	if (depth == maxDepth) {
+		return quiescence(board, 0, turn, alpha, beta);
+	}
+
+	if (visitNode()) return 0;
+
+#ifdef SEARCH_STATS
+	searchStats[omp_get_thread_num() % MAX_THREADS].nodes[depth]++;
+#endif
+
+	// the position may have been searched already through another move order
+	int ttScore, ttMove;
+	if (probeTransposition(board->hash, maxDepth - depth, alpha, beta, &ttScore, &ttMove)) {
+		return ttScore;
+	}
+
+	int alphaOrig = alpha, betaOrig = beta;
+	int bestIndex = -1;
+
+	// get the posible moves for this position
+	int numMoves = 0;
+	Move* moves = getPossibleMoves(board, turn, &numMoves);
+	orderMoves(board, turn, moves, numMoves, ttMove, depth);
+
+	int bestScore;
+
+	// AI turn,  max the score
+	if (turn == PLAYER2) {
+		int maxScore = -9999;
+
+		// for each of the possible moves, call minimax again
+		for (int i = 0; i < numMoves; i++) {
+			MoveUndo undo = makeMove(board, turn, moves[i]);
+			int score = minimax(board, maxDepth, depth + 1, PLAYER1, alpha, beta);
+			unmakeMove(board, undo);
+
+			if (score > maxScore) {
+				maxScore = score;
+				bestIndex = i;
+			}
+
+			if (maxScore > alpha)
+				alpha = maxScore;
+
+			// beta prunning
+			if (beta <= alpha) {
+				recordCutoff(turn, moves[i], depth, maxDepth - depth, i);
+				break;
+			}
+		}
+
+		bestScore = maxScore;
+		// my turn, min the score
+	} else {
+		int minScore = 9999;
+
+		// for each of the possible moves, call minimax again
+		for (int i = 0; i < numMoves; i++) {
+			MoveUndo undo = makeMove(board, turn, moves[i]);
+			int score = minimax(board, maxDepth, depth + 1, PLAYER2, alpha, beta);
+			unmakeMove(board, undo);
+
+			if (score < minScore) {
+				minScore = score;
+				bestIndex = i;
+			}
+
+			if (minScore < beta)
+				beta = minScore;
+
+			if (beta <= alpha) {
+				recordCutoff(turn, moves[i], depth, maxDepth - depth, i);
+				break;
+			}
+		}
+
+		bestScore = minScore;
+	}
+
+	int bestMove = (bestIndex >= 0) ? moves[bestIndex] & MOVE_KEY_MASK : 0;
+	releaseMoves(numMoves);
+
+	// don't keep results of a search cut short
+	if (isSearchAborted()) return 0;
+
+	// remember the result, a score outside the original window is only a bound
+	int bound = TT_EXACT;
+	if (bestScore <= alphaOrig)
+		bound = TT_UPPER;
+	else if (bestScore >= betaOrig)
+		bound = TT_LOWER;
+
+	storeTransposition(board->hash, maxDepth - depth, bestScore, bound, bestMove);
+
+	return bestScore;
+}
+
+// young brothers wait, the first move is searched before the others and the bound it gives is
+// shared by the tasks searching its brothers, which split again in the same way
+// must be called from inside a parallel region for the tasks to be run by more than one thread
+int parallelSearch(Board* board, int maxDepth, int depth, int turn, int alpha, int beta) {
+	int tablebaseScore;
+	if (probeTablebase(board, turn, &tablebaseScore)) return tablebaseScore;
+
+	if (maxDepth - depth < MIN_SPAWN_DEPTH) {
+		return minimax(board, maxDepth, depth, turn, alpha, beta);
+	}
+
+	if (visitNode()) return 0;
+
+#ifdef SEARCH_STATS
+	searchStats[omp_get_thread_num() % MAX_THREADS].nodes[depth]++;
+#endif
+
+	// the position may have been searched already through another move order
+	int ttScore, ttMove;
+	if (probeTransposition(board->hash, maxDepth - depth, alpha, beta, &ttScore, &ttMove)) {
+		return ttScore;
+	}
+
+	int alphaOrig = alpha, betaOrig = beta;
+	int maximizing = (turn == PLAYER2);
+	int nextTurn = maximizing ? PLAYER1 : PLAYER2;
+
+	int numMoves = 0;
+	Move* moves = getPossibleMoves(board, turn, &numMoves);
+	orderMoves(board, turn, moves, numMoves, ttMove, depth);
+
+	// a player without moves has lost
+	if (numMoves == 0) return maximizing ? -9999 : 9999;
+
+	// the eldest brother alone
+	MoveUndo undo = makeMove(board, turn, moves[0]);
+	int bestScore = parallelSearch(board, maxDepth, depth + 1, nextTurn, alpha, beta);
+	unmakeMove(board, undo);
+
+	int bestIndex = 0;
+	if (maximizing && bestScore > alpha) alpha = bestScore;
+	if (!maximizing && bestScore < beta) beta = bestScore;
+
+	// the split nodes only count their cutoffs, learning from them too searched more nodes
+	if (alpha >= beta)
+		countCutoff(0);
+
+	// the younger brothers as tasks, each one starting from the bounds found so far
+	// idle threads steal them, and the tasks they spawn deeper in the tree, so uneven subtrees get shared
+	if (alpha < beta) {
+		// the bounds and the best move are shared by the tasks of this node only, under a lock of its own
+		omp_lock_t lock;
+		omp_init_lock(&lock);
+
+		for (int i = 1; i < numMoves; ++i) {
+			#pragma omp task firstprivate(i) shared(moves, alpha, beta, bestScore, bestIndex, lock)
+			{
+				int localAlpha, localBeta;
+
+				omp_set_lock(&lock);
+				localAlpha = alpha;
+				localBeta = beta;
+				omp_unset_lock(&lock);
+
+				// skip it if a brother already caused a cutoff
+				if (localAlpha < localBeta) {
+					double spanStart = depth < TRACE_TASK_DEPTH ? traceBegin() : 0;
+
+					Board boardCopy = *board;
+					makeMove(&boardCopy, turn, moves[i]);
+					int score = parallelSearch(&boardCopy, maxDepth, depth + 1, nextTurn, localAlpha, localBeta);
+
+					if (depth < TRACE_TASK_DEPTH)
+						traceEnd(TRACE_TASK, spanStart, depth + 1);
+
+					omp_set_lock(&lock);
+					if (maximizing ? score > bestScore : score < bestScore) {
+						bestScore = score;
+						bestIndex = i;
+					}
+
+					// the brother that closes the window is the one that caused the cutoff
+					int cutoff = alpha < beta;
+					if (maximizing && bestScore > alpha) alpha = bestScore;
+					if (!maximizing && bestScore < beta) beta = bestScore;
+					cutoff = cutoff && alpha >= beta;
+					omp_unset_lock(&lock);
+
+					if (cutoff)
+						countCutoff(i);
+				}
+			}
+		}
+
+		// the board, the moves, the bounds and the lock are used by the tasks until they end
+		#pragma omp taskwait
+		omp_destroy_lock(&lock);
+	}
+
+	int bestMove = moves[bestIndex] & MOVE_KEY_MASK;
+	releaseMoves(numMoves);
+
+	// don't keep results of a search cut short
+	if (isSearchAborted()) return 0;
+
+	int bound = TT_EXACT;
+	if (bestScore <= alphaOrig)
+		bound = TT_UPPER;
+	else if (bestScore >= betaOrig)
+		bound = TT_LOWER;
+
+	storeTransposition(board->hash, maxDepth - depth, bestScore, bound, bestMove);
+
+	return bestScore;
+}
+
+// search one root move, the thread team of the rank takes the tasks spawned below it
+int searchRootMove(Board* board, int turn, Move move, int maxDepth, int alpha) {
+	double moveStart = traceBegin();
+	Board boardCopy = *board;
+	makeMove(&boardCopy, turn, move);
+
+	int score;
+
+	#pragma omp parallel
+	#pragma omp single
+	score = parallelSearch(&boardCopy, maxDepth, 0, PLAYER1, alpha, 9999);
+
+	traceEnd(TRACE_ROOT_MOVE, moveStart, moveDigits(move));
+
+	return score;
+}
+
+// worker side of getBestMoveForOpponent, search the root moves sent by rank 0 until it has no more
+// the move returned is the best one whose score beat its bound, the others only have an upper bound
+// returns 0 if the search ran out of time
+int searchJobs(Board* board, int turn, int maxDepth, int* fromRow, int* fromCol, int* toRow, int* toCol, int* score) {
+	*score = NO_SCORE;
+
+	while (1) {
+		int job[2]; // the packed move and the bound
+		MPI_Status status;
+		double waitStart = traceBegin();
+		MPI_Recv(job, 2, MPI_INT, 0, MPI_ANY_TAG, searchCommunicator, &status);
+		traceEnd(TRACE_WAIT_JOB, waitStart, 0);
+
+		if (status.MPI_TAG == TAG_STOP) break;
+
+		int result[2];
+		result[0] = searchRootMove(board, turn, job[0], maxDepth, job[1]);
+		result[1] = !isSearchAborted();
+		MPI_Send(result, 2, MPI_INT, 0, TAG_RESULT, searchCommunicator);
+
+		if (result[0] > job[1] && result[0] > *score) {
+			*fromRow = squareRow((job[0] >> 5) & 31);
+			*fromCol = squareCol((job[0] >> 5) & 31);
+			*toRow = squareRow(job[0] & 31);
+			*toCol = squareCol(job[0] & 31);
+			*score = result[0];
+		}
+	}
+
+	return !isSearchAborted();
+}
+
+// give the next root move to a worker, with the best score so far as the bound
+// returns 0 if there is none left or the search ran out of time
+int sendJob(int worker) {
+	if (rootQueue.nextMove >= rootQueue.numMoves || isSearchAborted()) return 0;
+
+	int job[2] = {rootQueue.moves[rootQueue.nextMove], rootQueue.bestScore};
+	MPI_Send(job, 2, MPI_INT, worker, TAG_JOB, searchCommunicator);
+	rootQueue.assigned[worker] = rootQueue.nextMove++;
+	rootQueue.busyWorkers++;
+
+	return 1;
+}
+
+// the score of a root move searched by a worker, which gets the next move right away
+void takeResult(int worker, int result[2]) {
+	rootQueue.busyWorkers--;
+
+	// a move not fully searched makes the whole depth useless
+	if (!result[1])
+		searchAborted = 1;
+	else if (result[0] > rootQueue.bestScore) {
+		rootQueue.bestScore = result[0];
+		rootQueue.bestMoveIndex = rootQueue.assigned[worker];
+	}
+
+	sendJob(worker);
+}
+
+// take the results the workers have sent without waiting for the others
+void serveWorkers() {
+	int arrived;
+	MPI_Status status;
+	MPI_Iprobe(MPI_ANY_SOURCE, TAG_RESULT, searchCommunicator, &arrived, &status);
+
+	while (arrived) {
+		int result[2]; // the score and whether the search finished
+		MPI_Recv(result, 2, MPI_INT, status.MPI_SOURCE, TAG_RESULT, searchCommunicator, MPI_STATUS_IGNORE);
+		takeResult(status.MPI_SOURCE, result);
+
+		MPI_Iprobe(MPI_ANY_SOURCE, TAG_RESULT, searchCommunicator, &arrived, &status);
+	}
+}
+
+// get the best move for the AI opponent
+// rank 0 hands out the root moves one at a time to the ranks that are free, the others call searchJobs
+// returns 0 if the search ran out of time, in that case the move must not be used
+int getBestMoveForOpponent(Board* board, int turn, int maxDepth, int* fromRow, int* fromCol, int* toRow, int* toCol, int* score, int rank, int numProcesses) {
+	// entries from earlier searches can be replaced by shallower ones of this search
+	transpositionAge++;
+
+	double depthStart = traceBegin();
+
+	if (rank != 0) {
+		int completed = searchJobs(board, turn, maxDepth, fromRow, fromCol, toRow, toCol, score);
+		traceEnd(TRACE_DEPTH, depthStart, maxDepth + 1);
+
+		return completed;
+	}
+
+	// get move possible moves to pick
+	int numMoves = 0;
+	Move* moves = getPossibleMoves(board, turn, &numMoves);
+
+	// the best move of the previous iteration is searched first
+	int ttScore, ttMove;
+	probeTransposition(board->hash, MAX_SEARCH_DEPTH, -9999, 9999, &ttScore, &ttMove);
+	orderMoves(board, turn, moves, numMoves, ttMove, 0);
+
+	// the first move is searched alone to get a bound for the others
+	int bestScore = searchRootMove(board, turn, moves[0], maxDepth, -9999);
+	int bestMoveIndex = 0;
+
+	if (numProcesses == 1) {
+		// no workers, the tasks of the root moves are shared by the threads of this rank
+		// and the best score and move by the tasks, under a lock of the root
+		omp_lock_t rootLock;
+		omp_init_lock(&rootLock);
+
+		#pragma omp parallel
+		#pragma omp single
+		for (int i = 1; i < numMoves; ++i) {
+			#pragma omp task firstprivate(i) shared(bestScore, bestMoveIndex, rootLock)
+			{
+				int alpha;
+
+				double waitStart = traceBegin();
+				omp_set_lock(&rootLock);
+				alpha = bestScore;
+				omp_unset_lock(&rootLock);
+				traceEnd(TRACE_LOCK, waitStart, moveDigits(moves[i]));
+
+				// each root move is searched on its own copy, made and unmade down the tree
+				double moveStart = traceBegin();
+				Board boardCopy = *board;
+
+				makeMove(&boardCopy, turn, moves[i]);
+				int score = parallelSearch(&boardCopy, maxDepth, 0, PLAYER1, alpha, 9999);
+				traceEnd(TRACE_ROOT_MOVE, moveStart, moveDigits(moves[i]));
+
+				waitStart = traceBegin();
+				omp_set_lock(&rootLock);
+				if (score > bestScore) {
+					bestScore = score;
+					bestMoveIndex = i;
+				}
+				omp_unset_lock(&rootLock);
+				traceEnd(TRACE_LOCK, waitStart, moveDigits(moves[i]));
+			}
+		}
+
+		omp_destroy_lock(&rootLock);
+	} else {
+		// the move each worker is searching
+		int assigned[numProcesses];
+		rootQueue.moves = moves;
+		rootQueue.numMoves = numMoves;
+		rootQueue.nextMove = 1;
+		rootQueue.assigned = assigned;
+		rootQueue.busyWorkers = 0;
+		rootQueue.bestScore = bestScore;
+		rootQueue.bestMoveIndex = 0;
+
+		for (int worker = 1; worker < numProcesses; ++worker)
+			sendJob(worker);
+
+		// rank 0 searches the moves the workers haven't taken, answering them from inside the search
+		while (rootQueue.nextMove < numMoves && !isSearchAborted()) {
+			int i = rootQueue.nextMove++;
+			int score = searchRootMove(board, turn, moves[i], maxDepth, rootQueue.bestScore);
+			if (!isSearchAborted() && score > rootQueue.bestScore) {
+				rootQueue.bestScore = score;
+				rootQueue.bestMoveIndex = i;
+			}
+
+			serveWorkers();
+		}
+
+		// the moves still being searched by the workers
+		while (rootQueue.busyWorkers > 0) {
+			int result[2];
+			MPI_Status status;
+			double waitStart = traceBegin();
+			MPI_Recv(result, 2, MPI_INT, MPI_ANY_SOURCE, TAG_RESULT, searchCommunicator, &status);
+			traceEnd(TRACE_WAIT_RESULT, waitStart, 0);
+			takeResult(status.MPI_SOURCE, result);
+		}
+
+		for (int worker = 1; worker < numProcesses; ++worker)
+			MPI_Send(NULL, 0, MPI_INT, worker, TAG_STOP, searchCommunicator);
+
+		bestScore = rootQueue.bestScore;
+		bestMoveIndex = rootQueue.bestMoveIndex;
+	}
+
+	Move bestMove = moves[bestMoveIndex];
+	releaseMoves(numMoves);
+
+	traceEnd(TRACE_DEPTH, depthStart, maxDepth + 1);
+
+	if (isSearchAborted()) return 0;
+
+	storeTransposition(board->hash, maxDepth + 1, bestScore, TT_EXACT, bestMove & MOVE_KEY_MASK);
+
+	// update variables
+	*fromRow = squareRow((bestMove >> 5) & 31);
+	*fromCol = squareCol((bestMove >> 5) & 31);
+	*toRow = squareRow(bestMove & 31);
+	*toCol = squareCol(bestMove & 31);
+	*score = bestScore;
+
+	return 1;
+}
+
+// iterative deepening, search one more ply at a time until the time budget is over
+// returns the number of plies of the deepest completed search, whose move is the one returned
+int getTimedMoveForOpponent(Board* board, int turn, double timeBudget, int* fromRow, int* fromCol, int* toRow, int* toCol, int* score, int rank, int numProcesses) {
+	int numMoves = 0;
+	Move* moves = getPossibleMoves(board, turn, &numMoves);
+
+	*fromRow = squareRow((moves[0] >> 5) & 31);
+	*fromCol = squareCol((moves[0] >> 5) & 31);
+	*toRow = squareRow(moves[0] & 31);
+	*toCol = squareCol(moves[0] & 31);
+	*score = 0;
+	releaseMoves(numMoves);
+
+	// nothing to think about with a single move
+	if (numMoves == 1) return 0;
+
+	// the workers have no move to propose until they complete a search
+	if (rank != 0) *score = NO_SCORE;
+
+	searchDeadline = omp_get_wtime() + timeBudget;
+	searchAborted = 0;
+
+	// a max depth of 0 already searches one ply, and it is too short to be aborted
+	int completedDepth = 0;
+	for (int maxDepth = 0; maxDepth < MAX_SEARCH_DEPTH; ++maxDepth) {
+		int bestFromRow = *fromRow, bestFromCol = *fromCol, bestToRow = *toRow, bestToCol = *toCol, bestScore = *score;
+
+		int completed = getBestMoveForOpponent(board, turn, maxDepth, &bestFromRow, &bestFromCol, &bestToRow, &bestToCol, &bestScore, rank, numProcesses);
+
+		int allCompleted;
+		double waitStart = traceBegin();
+		MPI_Allreduce(&completed, &allCompleted, 1, MPI_INT, MPI_MIN, searchCommunicator);
+		traceEnd(TRACE_REDUCE, waitStart, maxDepth + 1);
+		if (!allCompleted) break;
+
+		*fromRow = bestFromRow;
+		*fromCol = bestFromCol;
+		*toRow = bestToRow;
+		*toCol = bestToCol;
+		*score = bestScore;
+		completedDepth = maxDepth + 1;
+	}
+
+	searchDeadline = 0;
+	searchAborted = 0;
+
+	return completedDepth;
+}